@@ -20,13 +20,19 @@
 #include "Arduino.h"
 #include "serialServo.h"
 #include "bodyMovement.h"
+#include "bodyKinematics.h"
 #include "commandParser.h"
 #include "animationStore.h"
+#include "motionSensor.h"
+#include "balanceController.h"
 
 void setup() {
   Serial.begin(SERIAL_BAUD);
   SerialServo::begin();
   BodyMovement::begin();
+  BodyKinematics::begin();
+  MotionSensor::begin();
+  BalanceController::begin();
   AnimationStore::begin();
   CommandParser::begin();
 }
@@ -38,6 +44,10 @@ void loop() {
   _time = _time2;*/
   SerialServo::servoRoutine();
   BodyMovement::movementPlanner();
+  BodyKinematics::kinematicsRoutine();
+  MotionSensor::sensorRoutine();
+  BalanceController::balanceRoutine();
   AnimationStore::executeAnimation();
+  AnimationStore::compactRoutine();
   CommandParser::parseSerial();
 }
\ No newline at end of file
@@ -13,12 +13,16 @@
  * @copyright     Copyright (c) 2015, Simone Primarosa, (https://simoneprimarosa.com)
  * @link          (https://github.com/simonepri/RoboPrime)
  * @since         0.0.0
- * @require       bodyMovement
+ * @require       bodyMovement, gaitGenerator
  * @license       MIT License (https://opensource.org/licenses/MIT)
  */
 
 #include "Arduino.h"
+#include <avr/eeprom.h>
+#include "serialServo.h"
 #include "bodyMovement.h"
+#include "bodyKinematics.h"
+#include "gaitGenerator.h"
 
 #include "animationStore.h"
 
@@ -30,72 +34,146 @@ anim_t
   AnimationStore::anim;
 
 /**
- * "steps_size" array is located in FLASH memory and store information about the
- * number of steps of each animation.
+ * keyframe array is located in SRAM momery and store the time, in ms from the
+ * start of the animation, at which the planned steps of each bodypart end.
  */
-steps_size_t
-  AnimationStore::steps_size[ANIM_SIZE][ANIM_STEPS_DIV] = ANIM_STEPS_SIZE;
+uint16_t
+  AnimationStore::keyframe[HF_SIZE][HF_NUM];
 
 /**
- * "steps_*" arrays are located in FLASH memory and they store information about the
- * bodypart to move on each step for each animation.
+ * "directory" array is located in FLASH memory and store the first step and the
+ * number of start, loop and end steps of each animation.
+ */
+anim_dir_t
+  AnimationStore::directory[ANIM_SIZE][ANIM_DIR_SIZE] = ANIM_DIRECTORY;
+
+/**
+ * "steps" array is located in FLASH memory and store the packed steps of all
+ * the stored animations.
  */
 steps_info_t
-  AnimationStore::steps_FWW[ANIM_FWW_SIZE][ANIM_STEPS_INFO] = ANIM_FWW_STEPS;
-steps_info_t
-  AnimationStore::steps_BWW[ANIM_BWW_SIZE][ANIM_STEPS_INFO] = ANIM_BWW_STEPS,
-  AnimationStore::steps_SWR[ANIM_SWR_SIZE][ANIM_STEPS_INFO] = ANIM_SWR_STEPS,
-  AnimationStore::steps_SWL[ANIM_SWL_SIZE][ANIM_STEPS_INFO] = ANIM_SWL_STEPS,
-  AnimationStore::steps_CWSR[ANIM_CWSR_SIZE][ANIM_STEPS_INFO] = ANIM_CWSR_STEPS,
-  AnimationStore::steps_CCWSR[ANIM_CCWSR_SIZE][ANIM_STEPS_INFO] = ANIM_CCWSR_STEPS,
-  AnimationStore::steps_CWCW[ANIM_CWCW_SIZE][ANIM_STEPS_INFO] = ANIM_CWCW_STEPS,
-  AnimationStore::steps_CCWCW[ANIM_CCWCW_SIZE][ANIM_STEPS_INFO] = ANIM_CCWCW_STEPS,
-  AnimationStore::steps_SIT[ANIM_SIT_SIZE][ANIM_STEPS_INFO] = ANIM_SIT_STEPS,
-  AnimationStore::steps_HR[ANIM_HR_SIZE][ANIM_STEPS_INFO] = ANIM_HR_STEPS,
-  AnimationStore::steps_FOR[ANIM_FOR_SIZE][ANIM_STEPS_INFO] = ANIM_FOR_STEPS;
+  AnimationStore::steps[ANIM_STEPS_BYTES] = ANIM_STEPS;
+
+/**
+ * upload struct is located in SRAM momery and store the animation that is
+ * being uploaded into the EEPROM.
+ */
+anim_upload_t
+  AnimationStore::upload;
+
+/**
+ * compact struct is located in SRAM momery and store the animation that is
+ * being moved down the EEPROM, see compactRoutine.
+ */
+anim_compact_t
+  AnimationStore::compact;
+
+#if SERIAL_SERVO_TIMING
+/**
+ * timing struct is located in SRAM momery and store how long the steps took to
+ * be read.
+ */
+anim_timing_t
+  AnimationStore::timing;
+#endif
 
 /**
  * Initializes class's fields.
  */
 void AnimationStore::begin() {
   clearAnimation(true);
+  upload.slot = ANIM_NULL;
+  upload.size = 0;
+  upload.closing = 0;
+  compact.slot = ANIM_NULL;
+  compact.pending = true;                       // Ends a move cut by a reset.
+  clearTiming();
 }
 /**
- * Applies a specific animation.
+ * Applies a specific animation. Ids from ANIM_SIZE are the animations
+ * uploaded into the EEPROM, an empty slot stops the current animation, as
+ * any of them does while the EEPROM is compacted.
+ * The stored animations are played at their own speed, or scaled to last
+ * _time, counting the start, one loop and the end steps. Their amplitude is
+ * reset, see setAmplitude.
  * 
  * @param _anim animation id.
  * @param _dist distance to travel (for anmations that moves the robot).
- * @param _time the duration of the animation.
+ * @param _time the duration of the animation, 0 for its own.
  * @param _angle the angle to trvale (for anmations that rotates the robot).
  */
 void AnimationStore::applyAnimation(uint8_t _anim, uint16_t _dist,
                                     uint16_t _time, uint16_t _angle) {
+  BodyMovement::clearQueue();                   // Drops the previous one.
+  bool _eeprom = _anim >= ANIM_SIZE;
+  uint8_t _slot = _anim - ANIM_SIZE;
+  if(_eeprom && (_slot >= ANIM_EE_SLOTS || compact.pending ||
+                 raw_isEmpty(_slot))) {
+    return clearAnimation(true);
+  }
   BodyMovement::setSequence(true);
   anim.activeAnimation = _anim;
+  anim.busyAnimation = false;
+  anim.endingAnimation = false;
   anim.stepAnimation = 0;
   anim.timeAnimation = _time;
   anim.distAnimation = _dist;
   anim.angleAnimation = _angle;
 
-  anim.startAnimation = pgm_read_word_near(&(steps_size[_anim][ANIM_STEPS_START]));
-  anim.loopAnimation = pgm_read_word_near(&(steps_size[_anim][ANIM_STEPS_LOOP]));
-  anim.endAnimation = pgm_read_word_near(&(steps_size[_anim][ANIM_STEPS_END]));
+  BodyMovement::setEpoch();
+  anim.loopKeyframe = 0;
+  for(uint8_t _idx = 0; _idx < HF_NUM; _idx++) {
+    keyframe[HF_R][_idx] = keyframe[HF_L][_idx] = 0;
+  }
+
+  anim.eepromAnimation = _eeprom;
+  if(_eeprom) {
+    anim.offsetAnimation = raw_entry(_slot, ANIM_EE_OFFSET);
+    anim.startAnimation = raw_entry(_slot, ANIM_EE_START);
+    anim.loopAnimation = raw_entry(_slot, ANIM_EE_LOOP);
+    anim.endAnimation = raw_entry(_slot, ANIM_EE_END);
+  }
+  else {
+    anim.offsetAnimation = pgm_read_word_near(&(directory[_anim][ANIM_DIR_OFFSET]));
+    anim.startAnimation = pgm_read_word_near(&(directory[_anim][ANIM_DIR_START]));
+    anim.loopAnimation = pgm_read_word_near(&(directory[_anim][ANIM_DIR_LOOP]));
+    anim.endAnimation = pgm_read_word_near(&(directory[_anim][ANIM_DIR_END]));
+  }
+  anim.readOffset = anim.loopOffset = anim.offsetAnimation;
+  anim.timeScale = anim.angleScale = ANIM_SCALE_ONE;
+  if(anim.offsetAnimation == ANIM_GAIT) {
+    GaitGenerator::setGait(_anim, _dist, _time);
+  }
+  else if(_time) {
+    uint16_t _length = raw_bakedLength();
+    if(_length) {
+      uint32_t _scale = ((uint32_t(_time) << ANIM_SCALE_BITS) + _length / 2) /
+                        _length;
+      anim.timeScale = _scale > 0xFFFF ? 0xFFFF : (_scale ? _scale : 1);
+    }
+  }
+}
+
+/**
+ * Scales the angles of the stored animation being played around the default
+ * pose, within the bounds of each bodypart. The walks are not scaled.
+ *
+ * @param _scale Q8 factor, ANIM_SCALE_ONE plays the angles as they are.
+ */
+void AnimationStore::setAmplitude(uint16_t _scale) {
+  anim.angleScale = _scale;
 }
 
 /**
  * Stops an animation.
  *
- * @param _force .
+ * @param _force true to stop at once, dropping the planned steps, false to
+ * play the end steps after the current loop.
  */
 void AnimationStore::clearAnimation(bool _force) {
   if(_force) {
-    BodyMovement::setSequence(false);
-    anim.activeAnimation = ANIM_NULL;
-    anim.endingAnimation = false;
-    anim.stepAnimation = 0;
-    anim.timeAnimation = 0;
-    anim.distAnimation = 0;
-    anim.angleAnimation = 0;
+    BodyMovement::clearQueue();
+    raw_endAnimation();
   }
   else {
     anim.endingAnimation = true;
@@ -112,225 +190,621 @@ void AnimationStore::executeAnimation() {
   if(anim.activeAnimation == ANIM_NULL) {
     return;
   }
-  if(!anim.busyAnimation) {
-    nextStep(_half, _idx, _angle, _time);
+  if(!anim.busyAnimation && !nextStep(_half, _idx, _angle, _time)) {
+    return;                                     // Holding or just ended.
+  }
+  if(_idx >= HF_NUM) {
+    return;
+  }
+  if(_angle == INVALID_BODY_POS) {
+    keyframe[_half][_idx] += _time;             // Pauses are not queued.
+    return;
   }
-  bool _inserted = BodyMovement::pushQueue(_half, _idx, _angle, _time);
+  uint8_t _profile = anim.offsetAnimation == ANIM_GAIT ? GAIT_PROFILE :
+                                                         SWEEP_LINEAR;
+  bool _inserted = BodyMovement::pushKeyframe(_half, _idx, _angle, _time,
+                                              keyframe[_half][_idx], _profile);
   if(!_inserted) {
     anim.busyAnimation = true;
     return;
   }
+  keyframe[_half][_idx] += _time;
   anim.busyAnimation = false;
 }
 
 /**
- * Computes the next step for the current applied animation.
+ * Prints the step read time statistics as S <steps> <average cycles> <max
+ * cycles>, the walks included.
+ * Nothing is printed unless SERIAL_SERVO_TIMING is enabled.
+ */
+void AnimationStore::printTiming() {
+#if SERIAL_SERVO_TIMING
+  Serial.print('S');
+  Serial.print(' ');
+  Serial.print(timing.steps);
+  Serial.print(' ');
+  Serial.print(timing.steps ?
+               timing.sumTicks / timing.steps * PRESCALER_VALUE : 0);
+  Serial.print(' ');
+  Serial.print(timing.maxTicks * PRESCALER_VALUE);
+  Serial.println();
+#endif
+}
+
+/**
+ * Clears the step read time statistics.
+ */
+void AnimationStore::clearTiming() {
+#if SERIAL_SERVO_TIMING
+  timing.steps = 0;
+  timing.sumTicks = 0;
+  timing.maxTicks = 0;
+#endif
+}
+
+/**
+ * Opens the upload of an animation into an EEPROM slot, replacing the one that
+ * was there. The steps are sent one by one with uploadStep, in the order they
+ * are played, after the ones already stored, and the slot is filled only by
+ * endUpload, so a broken upload leaves the previous animation in place.
+ * Nothing can be uploaded while an EEPROM animation is played, while the
+ * previous upload is written or while the EEPROM is compacted, see
+ * compactRoutine.
+ *
+ * @param _slot slot index, the animation id is ANIM_SIZE + slot.
+ * @param _start steps played once at the start.
+ * @param _loop steps looped.
+ * @param _end steps played once at the end.
+ * @return false if the upload can not be opened.
+ */
+bool AnimationStore::beginUpload(uint8_t _slot, uint8_t _start, uint8_t _loop,
+                                 uint8_t _end) {
+  if(isWriting()) {
+    return false;
+  }
+  upload.slot = ANIM_NULL;
+  if(_slot >= ANIM_EE_SLOTS || anim.eepromAnimation || compact.pending) {
+    return false;
+  }
+  uint16_t _steps = uint16_t(_start) + _loop + _end;
+  if(_steps == 0 || _steps > ANIM_EE_MAX_STEPS) {
+    return false;
+  }
+  upload.slot = _slot;
+  upload.start = _start;
+  upload.loop = _loop;
+  upload.end = _end;
+  upload.steps = 0;
+  upload.offset = upload.writeOffset = raw_usedEnd();
+  return true;
+}
+
+/**
+ * Sends the next step of the open upload, packed as ANIM_MOVE or ANIM_WAIT.
+ * It is written by compactRoutine, a byte every 3.4ms, and no other step can
+ * be sent until isWriting is false.
+ *
+ * @param _half right or left body part.
+ * @param _idx body part index.
+ * @param _angle angle*10 to set, INVALID_BODY_POS for a wait.
+ * @param _time duration of the step.
+ * @return false if there is no open upload, the step is not valid or the
+ *         EEPROM is full.
+ */
+bool AnimationStore::uploadStep(bool _half, uint8_t _idx, uint16_t _angle,
+                                uint16_t _time) {
+  if(upload.slot == ANIM_NULL || isWriting() || _idx >= HF_NUM ||
+     upload.steps == uint16_t(upload.start) + upload.loop + upload.end) {
+    return false;
+  }
+  bool _wait = _angle == INVALID_BODY_POS;
+  if(!_wait && (_angle > MAX_SERVO_ANGLE || _time > ANIM_STEP_TIME_MASK)) {
+    return false;
+  }
+  uint8_t _size = _wait ? ANIM_STEP_WAIT_SIZE : ANIM_STEP_MOVE_SIZE;
+  if(upload.writeOffset + _size > ANIM_EE_LIMIT) {
+    return false;
+  }
+  uint8_t *_step = upload.step;
+  if(_wait) {
+    _step[0] = (_half ? ANIM_STEP_HALF : 0) | ANIM_STEP_WAIT | _idx;
+    _step[1] = _time;
+    _step[2] = _time >> 8;
+  }
+  else {
+    _step[0] = (_half ? ANIM_STEP_HALF : 0) | _idx;
+    _step[1] = _time;
+    _step[2] = ((_time >> 8) & 0x1F) | ((_angle & 0x07) << 5);
+    _step[3] = _angle >> 3;
+  }
+  upload.size = _size;
+  upload.written = 0;
+  upload.steps++;
+  return true;
+}
+
+/**
+ * Closes the open upload, its slot is then filled by compactRoutine, see
+ * raw_closeUpload, and isWriting is true until it is.
+ *
+ * @return false if there is no open upload or some steps are missing, the
+ *         upload is dropped anyway.
+ */
+bool AnimationStore::endUpload() {
+  if(isWriting()) {
+    return false;
+  }
+  if(upload.slot == ANIM_NULL ||
+     upload.steps != uint16_t(upload.start) + upload.loop + upload.end) {
+    upload.slot = ANIM_NULL;
+    return false;
+  }
+  upload.closing = 1;
+  return true;
+}
+
+/**
+ * Deletes an animation from the EEPROM, and cancels the open upload. The
+ * steps of the ones stored after it are then moved down by compactRoutine,
+ * so the free bytes are always at the end.
+ * Nothing can be deleted while an EEPROM animation is played or while the
+ * EEPROM is compacted.
+ *
+ * @param _slot slot index.
+ * @return false if the slot is not valid or is empty.
+ */
+bool AnimationStore::deleteAnimation(uint8_t _slot) {
+  if(_slot >= ANIM_EE_SLOTS || anim.eepromAnimation || compact.pending ||
+     isWriting() || raw_isEmpty(_slot)) {
+    return false;
+  }
+  upload.slot = ANIM_NULL;
+  eeprom_update_byte(raw_eeprom(ANIM_EE_DIR_ADDR(_slot) + ANIM_EE_OFFSET + 1),
+                     ANIM_EE_EMPTY);
+  compact.pending = true;
+  return true;
+}
+
+/**
+ * Checks if a step or the directory entry of an upload is still being
+ * written.
+ *
+ * @return true until the last write of uploadStep or endUpload has ended, so
+ *         the EEPROM can be read at once.
+ */
+bool AnimationStore::isWriting() {
+  return upload.size || upload.closing || !eeprom_is_ready();
+}
+
+/**
+ * This routine is called by the loop and writes the EEPROM, at most a byte
+ * each time and only once the previous write has ended, so the loop is never
+ * held. It writes the step sent last and the entry of a closed upload, then
+ * closes the gaps between the EEPROM animations. An animation being moved is
+ * emptied before any of its own steps is overwritten and filled again by the
+ * high byte of its new offset, written last: a reset in the middle loses at
+ * most that animation and never leaves a slot pointing at moved steps.
+ */
+void AnimationStore::compactRoutine() {
+  if(!eeprom_is_ready()) {
+    return;
+  }
+  if(upload.size) {
+    eeprom_update_byte(raw_eeprom(upload.writeOffset + upload.written),
+                       upload.step[upload.written]);
+    if(++upload.written == upload.size) {
+      upload.writeOffset += upload.size;
+      upload.size = 0;
+    }
+    return;
+  }
+  if(upload.closing) {
+    return raw_closeUpload();
+  }
+  if(!compact.pending) {
+    return;
+  }
+  if(compact.slot == ANIM_NULL) {
+    raw_nextMove();
+    return;
+  }
+  if(compact.from < compact.end) {
+    eeprom_update_byte(raw_eeprom(compact.to),
+                       eeprom_read_byte(raw_eeprom(compact.from)));
+    compact.from++;
+    compact.to++;
+    return;
+  }
+  uint8_t *_offset = raw_eeprom(ANIM_EE_DIR_ADDR(compact.slot) +
+                                ANIM_EE_OFFSET);
+  if(eeprom_read_byte(_offset + 1) != ANIM_EE_EMPTY) {
+    eeprom_update_byte(_offset + 1, ANIM_EE_EMPTY);
+  }
+  else if(eeprom_read_byte(_offset) != uint8_t(compact.offset)) {
+    eeprom_update_byte(_offset, compact.offset);
+  }
+  else {
+    eeprom_update_byte(_offset + 1, compact.offset >> 8);
+    compact.slot = ANIM_NULL;
+  }
+}
+
+/**
+ * Gets how many bytes of steps can still be uploaded.
+ *
+ * @return free bytes, a move takes 4 bytes and a wait 3.
+ */
+uint16_t AnimationStore::getFree() {
+  if(upload.slot != ANIM_NULL) {
+    return ANIM_EE_LIMIT - upload.writeOffset;
+  }
+  return ANIM_EE_LIMIT - ANIM_EE_DATA - raw_usedBytes();
+}
+
+/**
+ * Prints a line for each animation in the EEPROM as E <id> <bytes> <start
+ * steps> <loop steps> <end steps>, followed by E <free bytes>.
+ */
+void AnimationStore::printStored() {
+  for(uint8_t _slot = 0; _slot < ANIM_EE_SLOTS; _slot++) {
+    if(raw_isEmpty(_slot)) {
+      continue;
+    }
+    Serial.print('E');
+    Serial.print(' ');
+    Serial.print(ANIM_SIZE + _slot);
+    Serial.print(' ');
+    Serial.print(raw_entry(_slot, ANIM_EE_BYTES));
+    Serial.print(' ');
+    Serial.print(raw_entry(_slot, ANIM_EE_START));
+    Serial.print(' ');
+    Serial.print(raw_entry(_slot, ANIM_EE_LOOP));
+    Serial.print(' ');
+    Serial.print(raw_entry(_slot, ANIM_EE_END));
+    Serial.println();
+  }
+  Serial.print('E');
+  Serial.print(' ');
+  Serial.print(getFree());
+  Serial.println();
+}
+
+/**
+ * Aligns the keyframe time of all the bodyparts to the one whose steps end
+ * last, so that every loop of an animation starts together.
+ */
+void AnimationStore::alignKeyframes() {
+  uint16_t _loop = 0;
+  for(uint8_t _idx = 0; _idx < HF_NUM; _idx++) {
+    for(uint8_t _half = HF_R; _half < HF_SIZE; _half++) {
+      uint16_t _length = keyframe[_half][_idx] - anim.loopKeyframe;
+      if(_length > _loop) {
+        _loop = _length;
+      }
+    }
+  }
+  anim.loopKeyframe += _loop;
+  for(uint8_t _idx = 0; _idx < HF_NUM; _idx++) {
+    keyframe[HF_R][_idx] = keyframe[HF_L][_idx] = anim.loopKeyframe;
+  }
+}
+
+/**
+ * Computes the next step for the current applied animation. Walks are computed
+ * by GaitGenerator, the stored animations are read from the steps table,
+ * starting from the offset given by their directory entry.
  *
  * @param _half right or left body part.
  * @param _idx body part index.
  * @param _angle angle*10 to set.
  * @param _time duration of
+ * @return false if there is no step, as an animation with no loop steps is
+ *         held after its start steps until it is stopped, or it has just
+ *         ended.
  */
-void AnimationStore::nextStep(bool &_half, uint8_t &_idx, uint16_t &_angle,
+bool AnimationStore::nextStep(bool &_half, uint8_t &_idx, uint16_t &_angle,
                               uint16_t &_time) {
   if(!anim.endingAnimation && anim.loopAnimation == 0 && anim.stepAnimation == anim.startAnimation) {
-    return;
+    return false;
   }
   else if(!anim.endingAnimation && anim.stepAnimation == anim.startAnimation + anim.loopAnimation) {
     anim.stepAnimation = anim.startAnimation;
+    anim.readOffset = anim.loopOffset;
+    alignKeyframes();
   }
   else if(anim.stepAnimation == anim.startAnimation + anim.loopAnimation + anim.endAnimation) {
-    return clearAnimation(true);
+    raw_endAnimation();                         // The planned steps still play.
+    return false;
   }
 
-  switch(anim.activeAnimation) {
-    case ANIM_FWW: nextStepFWW(_half, _idx, _angle, _time); break;
-    case ANIM_BWW: nextStepBWW(_half, _idx, _angle, _time); break;
-    case ANIM_SWR: nextStepSWR(_half, _idx, _angle, _time); break;
-    case ANIM_SWL: nextStepSWL(_half, _idx, _angle, _time); break;
-    case ANIM_CWSR: nextStepCWSR(_half, _idx, _angle, _time); break;
-    case ANIM_CCWSR: nextStepCCWSR(_half, _idx, _angle, _time); break;
-    case ANIM_CWCW: nextStepCWCW(_half, _idx, _angle, _time); break;
-    case ANIM_CCWCW: nextStepCCWCW(_half, _idx, _angle, _time); break;
-    case ANIM_SIT: nextStepSIT(_half, _idx, _angle, _time); break;
-    case ANIM_HR: nextStepHR(_half, _idx, _angle, _time); break;
-    case ANIM_FOR: nextStepFOR(_half, _idx, _angle, _time); break;
+#if SERIAL_SERVO_TIMING
+  uint32_t _start = SerialServo::readClock();
+#endif
+  if(anim.offsetAnimation == ANIM_GAIT) {
+    if(GaitGenerator::nextStep(anim.stepAnimation, _half, _idx, _angle,
+                               _time)) {
+      clearAnimation();                         // Ends after this loop.
+    }
+  }
+  else {
+    if(anim.stepAnimation == anim.startAnimation) {
+      anim.loopOffset = anim.readOffset;
+    }
+    raw_readStep(_half, _idx, _angle, _time);
+    raw_scaleStep(_idx, _angle, _time);
   }
   anim.stepAnimation++;
+#if SERIAL_SERVO_TIMING
+  uint32_t _ticks = SerialServo::readClock() - _start;
+  timing.steps++;
+  timing.sumTicks += _ticks;
+  if(_ticks > timing.maxTicks) {
+    timing.maxTicks = _ticks;
+  }
+#endif
+  return true;
 }
 
 /**
- * See nextStep.
- *
- * @param _half right or left body part.
- * @param _idx body part index.
- * @param _angle angle*10 to set.
- * @param _time duration of
+ * Clears the current applied animation, once all its steps are planned or
+ * when it is stopped, see clearAnimation.
  */
-void AnimationStore::nextStepFWW(bool &_half, uint8_t &_idx, uint16_t &_angle,
-                                 uint16_t &_time) {
-  _half = pgm_read_word_near(&(steps_FWW[anim.stepAnimation][ANIM_STEPS_HF]));
-  _idx = pgm_read_word_near(&(steps_FWW[anim.stepAnimation][ANIM_STEPS_PART]));
-  _angle = pgm_read_word_near(&(steps_FWW[anim.stepAnimation][ANIM_STEPS_POS]));
-  _time = pgm_read_word_near(&(steps_FWW[anim.stepAnimation][ANIM_STEPS_TIME]));
+inline void AnimationStore::raw_endAnimation() {
+  BodyMovement::setSequence(false);
+  anim.activeAnimation = ANIM_NULL;
+  anim.eepromAnimation = false;
+  anim.busyAnimation = false;
+  anim.endingAnimation = false;
+  anim.stepAnimation = 0;
+  anim.timeAnimation = 0;
+  anim.distAnimation = 0;
+  anim.angleAnimation = 0;
 }
 
 /**
- * See nextStep.
+ * Reads and unpacks the next stored step, from the FLASH memory or from the
+ * EEPROM, see ANIM_MOVE and ANIM_WAIT.
  *
  * @param _half right or left body part.
  * @param _idx body part index.
- * @param _angle angle*10 to set.
- * @param _time duration of
+ * @param _angle angle*10 to set, INVALID_BODY_POS for a wait.
+ * @param _time duration of the step.
  */
-void AnimationStore::nextStepBWW(bool &_half, uint8_t &_idx, uint16_t &_angle,
-                                 uint16_t &_time) {
-  _half = pgm_read_word_near(&(steps_BWW[anim.stepAnimation][ANIM_STEPS_HF]));
-  _idx = pgm_read_word_near(&(steps_BWW[anim.stepAnimation][ANIM_STEPS_PART]));
-  _angle = pgm_read_word_near(&(steps_BWW[anim.stepAnimation][ANIM_STEPS_POS]));
-  _time = pgm_read_word_near(&(steps_BWW[anim.stepAnimation][ANIM_STEPS_TIME]));
+inline void AnimationStore::raw_readStep(bool &_half, uint8_t &_idx,
+                                         uint16_t &_angle, uint16_t &_time) {
+  uint32_t _step;
+  if(anim.eepromAnimation) {
+    eeprom_read_block(&_step, raw_eeprom(anim.readOffset), ANIM_STEP_FETCH);
+  }
+  else {
+    memcpy_P(&_step, &(steps[anim.readOffset]), ANIM_STEP_FETCH);
+  }
+  uint8_t _head = _step;
+  _half = _head & ANIM_STEP_HALF;
+  _idx = _head & ANIM_STEP_PART;
+  _step >>= 8;
+  if(_head & ANIM_STEP_WAIT) {
+    _angle = INVALID_BODY_POS;
+    _time = _step;
+    anim.readOffset += ANIM_STEP_WAIT_SIZE;
+    return;
+  }
+  _angle = _step >> ANIM_STEP_TIME_BITS;
+  _time = _step & ANIM_STEP_TIME_MASK;
+  anim.readOffset += ANIM_STEP_MOVE_SIZE;
 }
 
 /**
- * See nextStep.
+ * Scales a stored step by the time and the amplitude of the animation.
  *
- * @param _half right or left body part.
  * @param _idx body part index.
- * @param _angle angle*10 to set.
- * @param _time duration of
+ * @param _angle angle*10 to set, INVALID_BODY_POS for a wait.
+ * @param _time duration of the step.
  */
-void AnimationStore::nextStepSWR(bool &_half, uint8_t &_idx, uint16_t &_angle,
-                                 uint16_t &_time) {
-  _half = pgm_read_word_near(&(steps_SWR[anim.stepAnimation][ANIM_STEPS_HF]));
-  _idx = pgm_read_word_near(&(steps_SWR[anim.stepAnimation][ANIM_STEPS_PART]));
-  _angle = pgm_read_word_near(&(steps_SWR[anim.stepAnimation][ANIM_STEPS_POS]));
-  _time = pgm_read_word_near(&(steps_SWR[anim.stepAnimation][ANIM_STEPS_TIME]));
+inline void AnimationStore::raw_scaleStep(const uint8_t &_idx,
+                                          uint16_t &_angle, uint16_t &_time) {
+  if(anim.timeScale != ANIM_SCALE_ONE) {
+    uint32_t _scaled = (uint32_t(_time) * anim.timeScale +
+                        ANIM_SCALE_ONE / 2) >> ANIM_SCALE_BITS;
+    _time = _scaled > 0xFFFF ? 0xFFFF : _scaled;
+  }
+  if(anim.angleScale == ANIM_SCALE_ONE || _angle == INVALID_BODY_POS ||
+     _idx >= HF_NUM) {
+    return;
+  }
+  int16_t _default = BodyMovement::getDefaultPos(_idx);
+  int32_t _scaled = _default + ((int32_t(int16_t(_angle) - _default) *
+                                 anim.angleScale + ANIM_SCALE_ONE / 2) >>
+                                ANIM_SCALE_BITS);
+  int32_t _min = BodyMovement::getMinPos(_idx);
+  int32_t _max = BodyMovement::getMaxPos(_idx);
+  _angle = _scaled < _min ? _min : (_scaled > _max ? _max : _scaled);
 }
 
 /**
- * See nextStep.
+ * Reads all the steps of the stored animation being applied, as they are
+ * played once, to find how long it lasts. The bodyparts are aligned after the
+ * loop, see alignKeyframes.
  *
- * @param _half right or left body part.
- * @param _idx body part index.
- * @param _angle angle*10 to set.
- * @param _time duration of
+ * @return length of the animation in ms, 0xFFFF at most.
  */
-void AnimationStore::nextStepSWL(bool &_half, uint8_t &_idx, uint16_t &_angle,
-                                 uint16_t &_time) {
-  _half = pgm_read_word_near(&(steps_SWL[anim.stepAnimation][ANIM_STEPS_HF]));
-  _idx = pgm_read_word_near(&(steps_SWL[anim.stepAnimation][ANIM_STEPS_PART]));
-  _angle = pgm_read_word_near(&(steps_SWL[anim.stepAnimation][ANIM_STEPS_POS]));
-  _time = pgm_read_word_near(&(steps_SWL[anim.stepAnimation][ANIM_STEPS_TIME]));
+inline uint16_t AnimationStore::raw_bakedLength() {
+  uint32_t _end[HF_SIZE][HF_NUM] = {{0}};
+  uint32_t _length = 0;
+  uint16_t _steps = uint16_t(anim.startAnimation) + anim.loopAnimation +
+                    anim.endAnimation;
+  for(uint16_t _step = 0; _step < _steps; _step++) {
+    if(_step == anim.startAnimation + anim.loopAnimation) {
+      for(uint8_t _idx = 0; _idx < HF_NUM; _idx++) {
+        _end[HF_R][_idx] = _end[HF_L][_idx] = _length;
+      }
+    }
+    bool _half;
+    uint8_t _idx;
+    uint16_t _angle, _time;
+    raw_readStep(_half, _idx, _angle, _time);
+    if(_idx < HF_NUM) {
+      _end[_half][_idx] += _time;
+      if(_end[_half][_idx] > _length) {
+        _length = _end[_half][_idx];
+      }
+    }
+  }
+  anim.readOffset = anim.offsetAnimation;
+  return _length > 0xFFFF ? 0xFFFF : _length;
 }
 
 /**
- * See nextStep.
+ * Reads a field of the EEPROM directory.
  *
- * @param _half right or left body part.
- * @param _idx body part index.
- * @param _angle angle*10 to set.
- * @param _time duration of
+ * @param _slot slot index.
+ * @param _field field offset, see ANIM_EE_*.
+ * @return field value.
  */
-void AnimationStore::nextStepCWSR(bool &_half, uint8_t &_idx, uint16_t &_angle,
-                                  uint16_t &_time) {
-  _half = pgm_read_word_near(&(steps_CWSR[anim.stepAnimation][ANIM_STEPS_HF]));
-  _idx = pgm_read_word_near(&(steps_CWSR[anim.stepAnimation][ANIM_STEPS_PART]));
-  _angle = pgm_read_word_near(&(steps_CWSR[anim.stepAnimation][ANIM_STEPS_POS]));
-  _time = pgm_read_word_near(&(steps_CWSR[anim.stepAnimation][ANIM_STEPS_TIME]));
+inline uint16_t AnimationStore::raw_entry(const uint8_t &_slot,
+                                          const uint8_t &_field) {
+  uint8_t *_addr = raw_eeprom(ANIM_EE_DIR_ADDR(_slot) + _field);
+  if(_field < ANIM_EE_START) {
+    return eeprom_read_word((const uint16_t *)_addr);
+  }
+  return eeprom_read_byte(_addr);
 }
 
 /**
- * See nextStep.
- *
- * @param _half right or left body part.
- * @param _idx body part index.
- * @param _angle angle*10 to set.
- * @param _time duration of
+ * Writes the next byte of the entry of the closed upload. The slot is
+ * emptied before its fields are written and filled by the high byte of the
+ * offset, written last, so a reset in the middle never leaves it half
+ * written. The steps of the animation it replaces are then dropped by the
+ * compaction.
  */
-void AnimationStore::nextStepCCWSR(bool &_half, uint8_t &_idx, uint16_t &_angle,
-                                   uint16_t &_time) {
-  _half = pgm_read_word_near(&(steps_CCWSR[anim.stepAnimation][ANIM_STEPS_HF]));
-  _idx = pgm_read_word_near(&(steps_CCWSR[anim.stepAnimation][ANIM_STEPS_PART]));
-  _angle = pgm_read_word_near(&(steps_CCWSR[anim.stepAnimation][ANIM_STEPS_POS]));
-  _time = pgm_read_word_near(&(steps_CCWSR[anim.stepAnimation][ANIM_STEPS_TIME]));
+inline void AnimationStore::raw_closeUpload() {
+  uint8_t *_entry = raw_eeprom(ANIM_EE_DIR_ADDR(upload.slot));
+  uint16_t _bytes = upload.writeOffset - upload.offset;
+  switch(upload.closing++) {
+    case 1:
+      eeprom_update_byte(_entry + ANIM_EE_OFFSET + 1, ANIM_EE_EMPTY);
+      return;
+    case 2:
+      eeprom_update_byte(_entry + ANIM_EE_BYTES, _bytes);
+      return;
+    case 3:
+      eeprom_update_byte(_entry + ANIM_EE_BYTES + 1, _bytes >> 8);
+      return;
+    case 4:
+      eeprom_update_byte(_entry + ANIM_EE_START, upload.start);
+      return;
+    case 5:
+      eeprom_update_byte(_entry + ANIM_EE_LOOP, upload.loop);
+      return;
+    case 6:
+      eeprom_update_byte(_entry + ANIM_EE_END, upload.end);
+      return;
+    case 7:
+      eeprom_update_byte(_entry + ANIM_EE_OFFSET, upload.offset);
+      return;
+  }
+  eeprom_update_byte(_entry + ANIM_EE_OFFSET + 1, upload.offset >> 8);
+  upload.slot = ANIM_NULL;
+  upload.closing = 0;
+  compact.pending = true;
 }
 
 /**
- * See nextStep.
+ * Gets the pointer that the eeprom_* functions take for an EEPROM address.
  *
- * @param _half right or left body part.
- * @param _idx body part index.
- * @param _angle angle*10 to set.
- * @param _time duration of
+ * @param _addr EEPROM address.
+ * @return pointer.
  */
-void AnimationStore::nextStepCWCW(bool &_half, uint8_t &_idx, uint16_t &_angle,
-                                  uint16_t &_time) {
-  _half = pgm_read_word_near(&(steps_CWCW[anim.stepAnimation][ANIM_STEPS_HF]));
-  _idx = pgm_read_word_near(&(steps_CWCW[anim.stepAnimation][ANIM_STEPS_PART]));
-  _angle = pgm_read_word_near(&(steps_CWCW[anim.stepAnimation][ANIM_STEPS_POS]));
-  _time = pgm_read_word_near(&(steps_CWCW[anim.stepAnimation][ANIM_STEPS_TIME]));
+inline uint8_t *AnimationStore::raw_eeprom(const uint16_t &_addr) {
+  return (uint8_t *)uintptr_t(_addr);
 }
 
 /**
- * See nextStep.
+ * Checks if an EEPROM slot is empty.
  *
- * @param _half right or left body part.
- * @param _idx body part index.
- * @param _angle angle*10 to set.
- * @param _time duration of
+ * @param _slot slot index.
+ * @return true if the slot is empty.
  */
-void AnimationStore::nextStepCCWCW(bool &_half, uint8_t &_idx, uint16_t &_angle,
-                                   uint16_t &_time) {
-  _half = pgm_read_word_near(&(steps_CCWCW[anim.stepAnimation][ANIM_STEPS_HF]));
-  _idx = pgm_read_word_near(&(steps_CCWCW[anim.stepAnimation][ANIM_STEPS_PART]));
-  _angle = pgm_read_word_near(&(steps_CCWCW[anim.stepAnimation][ANIM_STEPS_POS]));
-  _time = pgm_read_word_near(&(steps_CCWCW[anim.stepAnimation][ANIM_STEPS_TIME]));
+inline bool AnimationStore::raw_isEmpty(const uint8_t &_slot) {
+  return eeprom_read_byte(raw_eeprom(ANIM_EE_DIR_ADDR(_slot) +
+                                     ANIM_EE_OFFSET + 1)) == ANIM_EE_EMPTY;
 }
 
 /**
- * See nextStep.
+ * Gets the first byte after the steps of all the EEPROM animations, which are
+ * kept back to back from ANIM_EE_DATA once compacted, see compactRoutine.
  *
- * @param _half right or left body part.
- * @param _idx body part index.
- * @param _angle angle*10 to set.
- * @param _time duration of
+ * @return first free byte.
  */
-void AnimationStore::nextStepSIT(bool &_half, uint8_t &_idx, uint16_t &_angle,
-                                 uint16_t &_time) {
-  _half = pgm_read_word_near(&(steps_SIT[anim.stepAnimation][ANIM_STEPS_HF]));
-  _idx = pgm_read_word_near(&(steps_SIT[anim.stepAnimation][ANIM_STEPS_PART]));
-  _angle = pgm_read_word_near(&(steps_SIT[anim.stepAnimation][ANIM_STEPS_POS]));
-  _time = pgm_read_word_near(&(steps_SIT[anim.stepAnimation][ANIM_STEPS_TIME]));
+inline uint16_t AnimationStore::raw_usedEnd() {
+  uint16_t _end = ANIM_EE_DATA;
+  for(uint8_t _slot = 0; _slot < ANIM_EE_SLOTS; _slot++) {
+    if(raw_isEmpty(_slot)) {
+      continue;
+    }
+    uint16_t _slotEnd = raw_entry(_slot, ANIM_EE_OFFSET) +
+                        raw_entry(_slot, ANIM_EE_BYTES);
+    if(_slotEnd > _end) {
+      _end = _slotEnd;
+    }
+  }
+  return _end;
 }
 
 /**
- * See nextStep.
+ * Gets how many bytes the steps of all the EEPROM animations take, the one
+ * being moved included.
  *
- * @param _half right or left body part.
- * @param _idx body part index.
- * @param _angle angle*10 to set.
- * @param _time duration of
+ * @return used bytes.
  */
-void AnimationStore::nextStepHR(bool &_half, uint8_t &_idx, uint16_t &_angle,
-                                 uint16_t &_time) {
-  _half = pgm_read_word_near(&(steps_HR[anim.stepAnimation][ANIM_STEPS_HF]));
-  _idx = pgm_read_word_near(&(steps_HR[anim.stepAnimation][ANIM_STEPS_PART]));
-  _angle = pgm_read_word_near(&(steps_HR[anim.stepAnimation][ANIM_STEPS_POS]));
-  _time = pgm_read_word_near(&(steps_HR[anim.stepAnimation][ANIM_STEPS_TIME]));
+inline uint16_t AnimationStore::raw_usedBytes() {
+  uint16_t _bytes = 0;
+  for(uint8_t _slot = 0; _slot < ANIM_EE_SLOTS; _slot++) {
+    if(!raw_isEmpty(_slot) || _slot == compact.slot) {
+      _bytes += raw_entry(_slot, ANIM_EE_BYTES);
+    }
+  }
+  return _bytes;
 }
 
 /**
- * See nextStep.
- *
- * @param _half right or left body part.
- * @param _idx body part index.
- * @param _angle angle*10 to set.
- * @param _time duration of
+ * Starts moving down the EEPROM animation with the lowest offset that has a
+ * gap before it, or ends the compaction if there is none. It is emptied at
+ * once if its new place overlaps its steps.
  */
-void AnimationStore::nextStepFOR(bool &_half, uint8_t &_idx, uint16_t &_angle,
-                                 uint16_t &_time) {
-  _half = pgm_read_word_near(&(steps_FOR[anim.stepAnimation][ANIM_STEPS_HF]));
-  _idx = pgm_read_word_near(&(steps_FOR[anim.stepAnimation][ANIM_STEPS_PART]));
-  _angle = pgm_read_word_near(&(steps_FOR[anim.stepAnimation][ANIM_STEPS_POS]));
-  _time = pgm_read_word_near(&(steps_FOR[anim.stepAnimation][ANIM_STEPS_TIME]));
+inline void AnimationStore::raw_nextMove() {
+  for(uint8_t _slot = 0; _slot < ANIM_EE_SLOTS; _slot++) {
+    if(raw_isEmpty(_slot)) {
+      continue;
+    }
+    uint16_t _offset = raw_entry(_slot, ANIM_EE_OFFSET);
+    uint16_t _target = ANIM_EE_DATA;
+    for(uint8_t _other = 0; _other < ANIM_EE_SLOTS; _other++) {
+      if(_other == _slot || raw_isEmpty(_other) ||
+         raw_entry(_other, ANIM_EE_OFFSET) > _offset) {
+        continue;
+      }
+      uint16_t _otherEnd = raw_entry(_other, ANIM_EE_OFFSET) +
+                           raw_entry(_other, ANIM_EE_BYTES);
+      if(_otherEnd > _target) {
+        _target = _otherEnd;
+      }
+    }
+    if(_target < _offset &&
+       (compact.slot == ANIM_NULL || _offset < compact.from)) {
+      compact.slot = _slot;
+      compact.offset = _target;
+      compact.from = _offset;
+    }
+  }
+  if(compact.slot == ANIM_NULL) {
+    compact.pending = false;
+    return;
+  }
+  compact.to = compact.offset;
+  compact.end = compact.from + raw_entry(compact.slot, ANIM_EE_BYTES);
+  if(compact.offset + raw_entry(compact.slot, ANIM_EE_BYTES) > compact.from) {
+    eeprom_update_byte(raw_eeprom(ANIM_EE_DIR_ADDR(compact.slot) +
+                                  ANIM_EE_OFFSET + 1), ANIM_EE_EMPTY);
+  }
 }
@@ -13,7 +13,7 @@
  * @copyright     Copyright (c) 2015, Simone Primarosa, (https://simoneprimarosa.com)
  * @link          (https://github.com/simonepri/RoboPrime)
  * @since         0.0.0
- * @require       SerialServo
+ * @require       SerialServo, GaitGenerator
  * @license       MIT License (https://opensource.org/licenses/MIT)
  */
 
@@ -22,18 +22,41 @@
  *
  * This creates a class that adds movements to the queue in order to achieve 
  * some basic robot animations.
- * The code for the animations can be generated with the AnimHelper program.
+ * The code for the animations can be generated with the AnimHelper program,
+ * while the walks are computed on the fly by GaitGenerator.
+ * Stored animations are data only: a directory in FLASH memory gives for each
+ * animation its first step and its start, loop and end step counts, and the
+ * steps of all of them are in one table read by a single interpreter, so
+ * adding an animation is adding its steps and its directory entry.
+ * Steps are packed in 4 bytes, 3 for a wait, instead of four 16 bit values,
+ * so the same FLASH memory holds more than twice the steps, see ANIM_MOVE.
+ * More animations can be uploaded from the serial port into the EEPROM, with
+ * the same packed steps, see beginUpload. Their directory is at the start of
+ * the EEPROM and they are played as the ids after the stored ones, reading
+ * one step at a time, so they take no more SRAM than the FLASH ones.
+ * The uploaded steps and directory entries are written a byte at a time by
+ * compactRoutine, which also keeps the steps back to back, closing the gap
+ * left by a deleted animation, so the loop is never held by the slow EEPROM
+ * writes.
+ * Stored animations can be played at another speed and amplitude: the step
+ * times are scaled so the animation lasts the requested time, and the angles
+ * are scaled around the default pose, both in fixed point as each step is
+ * read, see raw_scaleStep.
+ * Steps are queued as keyframes: each bodypart keeps the time at which its
+ * planned steps end, counted from the start of the animation, and pauses only
+ * move that time forward. At every loop all the bodyparts are aligned to the
+ * one that ends last, so a looped animation never drifts.
  *
  * Implemented animations:
  * BASIC MOVMENTS:
- *  - Forward walk.                         WIP
- *  - Backward walk.                        NO
- *  - Side walk to right.                   NO
- *  - Side walk to left.                    NO
- *  - Clockwise standstill rotation.        NO
- *  - Counterclockwise standstill rotation. NO
- *  - Clockwise curved walk.                NO
- *  - Counterclockwise curved walk.         NO
+ *  - Forward walk.                         DONE
+ *  - Backward walk.                        DONE
+ *  - Side walk to right.                   DONE
+ *  - Side walk to left.                    DONE
+ *  - Clockwise standstill rotation.        DONE
+ *  - Counterclockwise standstill rotation. DONE
+ *  - Clockwise curved walk.                DONE
+ *  - Counterclockwise curved walk.         DONE
  *  - Sit down.                             DONE
  *  - Hello.                                DONE
  *  - Fuck off.                             DONE
@@ -57,206 +80,202 @@
 #define ANIM_SIZE                 11
 #define ANIM_NULL                255
 
-#define ANIM_STEPS_START          0
-#define ANIM_STEPS_LOOP           1
-#define ANIM_STEPS_END            2
-#define ANIM_STEPS_DIV            3
+#define ANIM_EE_SLOTS             8     // Uploaded animations, ids from ANIM_SIZE.
 
-#define ANIM_STEPS_HF             0
-#define ANIM_STEPS_PART           1
-#define ANIM_STEPS_POS            2
-#define ANIM_STEPS_TIME           3
-#define ANIM_STEPS_INFO           4
+#define ANIM_SCALE_BITS           8     // Scales are Q8.
+#define ANIM_SCALE_ONE          256
 
-#define ANIM_STEPS_SIZE {         \
-  {2, 43, 0},                     \
-  {0, 0, 0},                      \
-  {0, 0, 0},                      \
-  {0, 0, 0},                      \
-  {0, 0, 0},                      \
-  {0, 0, 0},                      \
-  {0, 0, 0},                      \
-  {0, 0, 0},                      \
-  {56, 0, 0},                     \
-  {5, 2, 0},                      \
-  {8, 9, 0},                     \
-}
+#define ANIM_DIR_OFFSET           0     // First byte in ANIM_STEPS.
+#define ANIM_DIR_START            1
+#define ANIM_DIR_LOOP             2
+#define ANIM_DIR_END              3
+#define ANIM_DIR_SIZE             4
 
-#define ANIM_FWW_SIZE             45
-#define ANIM_BWW_SIZE             1
-#define ANIM_SWR_SIZE             1
-#define ANIM_SWL_SIZE             1
-#define ANIM_CWSR_SIZE            1
-#define ANIM_CCWSR_SIZE           1
-#define ANIM_CWCW_SIZE            1
-#define ANIM_CCWCW_SIZE           1
-#define ANIM_SIT_SIZE             56
-#define ANIM_HR_SIZE              7
-#define ANIM_FOR_SIZE             17
+#define ANIM_GAIT            0xFFFF     // Offset of the walks, see GaitGenerator.
 
-#define ANIM_FWW_STEPS {                               \
-  {HF_L, PART_SHOULDER_Y_ROT, INVALID_BODY_POS, 500},  \
-  {HF_L, PART_SHOULDER_Y_ROT, 500, 250},               \
-  {HF_L, PART_ANKLE_X_ROT, INVALID_BODY_POS, 500},     \
-  {HF_L, PART_ANKLE_X_ROT, 850, 500},                  \
-  {HF_R, PART_ANKLE_X_ROT, INVALID_BODY_POS, 500},     \
-  {HF_R, PART_ANKLE_X_ROT, 1050, 500},                 \
-  {HF_L, PART_SHOULDER_Y_ROT, INVALID_BODY_POS, 250},  \
-  {HF_L, PART_SHOULDER_Y_ROT, 300, 250},               \
-  {HF_R, PART_KNEE_X_ROT, INVALID_BODY_POS, 2000},     \
-  {HF_R, PART_KNEE_X_ROT, 1100, 500},                  \
-  {HF_L, PART_KNEE_X_ROT, INVALID_BODY_POS, 2000},     \
-  {HF_L, PART_KNEE_X_ROT, 1325, 500},                  \
-  {HF_R, PART_HIP_Y_ROT, INVALID_BODY_POS, 2000},      \
-  {HF_R, PART_HIP_Y_ROT, 600, 500},                    \
-  {HF_R, PART_HIP_X_ROT, INVALID_BODY_POS, 2000},      \
-  {HF_R, PART_HIP_X_ROT, 1000, 500},                   \
-  {HF_R, PART_SHOULDER_Y_ROT, INVALID_BODY_POS, 3000}, \
-  {HF_R, PART_SHOULDER_Y_ROT, 500, 250},               \
-  {HF_R, PART_ANKLE_X_ROT, INVALID_BODY_POS, 2000},    \
-  {HF_R, PART_ANKLE_X_ROT, 850, 500},                  \
-  {HF_L, PART_ANKLE_X_ROT, INVALID_BODY_POS, 2000},    \
-  {HF_L, PART_ANKLE_X_ROT, 1050, 500},                 \
-  {HF_R, PART_SHOULDER_Y_ROT, INVALID_BODY_POS, 250},  \
-  {HF_R, PART_SHOULDER_Y_ROT, 300, 250},               \
-  {HF_R, PART_KNEE_X_ROT, INVALID_BODY_POS, 1500},     \
-  {HF_R, PART_KNEE_X_ROT, 1300, 500},                  \
-  {HF_R, PART_HIP_Y_ROT, INVALID_BODY_POS, 1500},      \
-  {HF_R, PART_HIP_Y_ROT, 850, 500},                    \
-  {HF_L, PART_ANKLE_X_ROT, INVALID_BODY_POS, 2000},    \
-  {HF_L, PART_ANKLE_X_ROT, 900, 500},                  \
-  {HF_R, PART_ANKLE_X_ROT, INVALID_BODY_POS, 2000},    \
-  {HF_R, PART_ANKLE_X_ROT, 900, 500},                  \
-  {HF_L, PART_KNEE_X_ROT, INVALID_BODY_POS, 3000},     \
-  {HF_L, PART_KNEE_X_ROT, 1300, 500},                  \
-  {HF_R, PART_HIP_Y_ROT, INVALID_BODY_POS, 1000},      \
-  {HF_R, PART_HIP_Y_ROT, 850, 500},                    \
-  {HF_L, PART_HIP_Y_ROT, INVALID_BODY_POS, 5500},      \
-  {HF_L, PART_HIP_Y_ROT, 850, 500},                    \
-  {HF_R, PART_HIP_X_ROT, INVALID_BODY_POS, 3000},      \
-  {HF_R, PART_HIP_X_ROT, 900, 500},                    \
-  {HF_R, PART_KNEE_X_ROT, INVALID_BODY_POS, 1500},     \
-  {HF_R, PART_SHOULDER_Y_ROT, INVALID_BODY_POS, 2250}, \
-  {HF_L, PART_SHOULDER_Y_ROT, INVALID_BODY_POS, 4750}, \
-}
-#define ANIM_BWW_STEPS {                    \
-  {HF_SIZE, PART_SIZE, INVALID_BODY_POS, 0} \
-}
-#define ANIM_SWR_STEPS {                    \
-  {HF_SIZE, PART_SIZE, INVALID_BODY_POS, 0} \
-}
-#define ANIM_SWL_STEPS {                    \
-  {HF_SIZE, PART_SIZE, INVALID_BODY_POS, 0} \
-}
-#define ANIM_CWSR_STEPS {                   \
-  {HF_SIZE, PART_SIZE, INVALID_BODY_POS, 0} \
-}
-#define ANIM_CCWSR_STEPS {                  \
-  {HF_SIZE, PART_SIZE, INVALID_BODY_POS, 0} \
-}
-#define ANIM_CWCW_STEPS {                   \
-  {HF_SIZE, PART_SIZE, INVALID_BODY_POS, 0} \
-}
-#define ANIM_CCWCW_STEPS {                  \
-  {HF_SIZE, PART_SIZE, INVALID_BODY_POS, 0} \
-}
-#define ANIM_SIT_STEPS {                                 \
-  {HF_R, PART_ANKLE_X_ROT, 950, 1000},                   \
-  {HF_L, PART_ANKLE_X_ROT, 950, 1000},                   \
-  {HF_R, PART_ANKLE_Y_ROT, 1800, 1000},                  \
-  {HF_L, PART_ANKLE_Y_ROT, 1800, 1000},                  \
-  {HF_L, PART_KNEE_X_ROT, 0, 1000},                      \
-  {HF_R, PART_KNEE_X_ROT, 0, 1000},                      \
-  {HF_R, PART_HIP_Y_ROT, 500, 1000},                     \
-  {HF_L, PART_HIP_Y_ROT, 500, 1000},                     \
-  {HF_L, PART_SHOULDER_X_ROT, INVALID_BODY_POS, 1000},   \
-  {HF_L, PART_SHOULDER_X_ROT, 500, 1000},                \
-  {HF_R, PART_SHOULDER_X_ROT, INVALID_BODY_POS, 1000},   \
-  {HF_R, PART_SHOULDER_X_ROT, 500, 1000},                \
-  {HF_L, PART_ELBOW_Z_ROT, INVALID_BODY_POS, 1000},      \
-  {HF_L, PART_ELBOW_Z_ROT, 500, 1000},                   \
-  {HF_R, PART_ELBOW_Z_ROT, INVALID_BODY_POS, 1000},      \
-  {HF_R, PART_ELBOW_Z_ROT, 500, 1000},                   \
-  {HF_L, PART_ELBOW_X_ROT, INVALID_BODY_POS, 1000},      \
-  {HF_L, PART_ELBOW_X_ROT, 1500, 1000},                  \
-  {HF_R, PART_ELBOW_X_ROT, INVALID_BODY_POS, 1000},      \
-  {HF_R, PART_ELBOW_X_ROT, 1500, 1000},                  \
-  {HF_R, PART_HIP_Y_ROT, INVALID_BODY_POS, 1000},        \
-  {HF_R, PART_HIP_Y_ROT, 1000, 1000},                    \
-  {HF_L, PART_HIP_Y_ROT, INVALID_BODY_POS, 1000},        \
-  {HF_L, PART_HIP_Y_ROT, 1000, 1000},                    \
-  {HF_L, PART_SHOULDER_X_ROT, 0, 1000},                  \
-  {HF_R, PART_SHOULDER_X_ROT, 0, 1000},                  \
-  {HF_R, PART_ANKLE_Y_ROT, INVALID_BODY_POS, 2000},      \
-  {HF_R, PART_ANKLE_Y_ROT, 1200, 1000},                  \
-  {HF_L, PART_ANKLE_Y_ROT, INVALID_BODY_POS, 2000},      \
-  {HF_L, PART_ANKLE_Y_ROT, 1200, 1000},                  \
-  {HF_L, PART_KNEE_X_ROT, INVALID_BODY_POS, 2000},       \
-  {HF_L, PART_KNEE_X_ROT, 1400, 1000},                   \
-  {HF_R, PART_KNEE_X_ROT, INVALID_BODY_POS, 2000},       \
-  {HF_R, PART_KNEE_X_ROT, 1400, 1000},                   \
-  {HF_R, PART_HIP_Y_ROT, 100, 1000},                     \
-  {HF_L, PART_HIP_Y_ROT, 0, 1000},                       \
-  {HF_R, PART_ELBOW_X_ROT, INVALID_BODY_POS, 1000},      \
-  {HF_R, PART_ELBOW_X_ROT, 1200, 1000},                  \
-  {HF_L, PART_ELBOW_X_ROT, INVALID_BODY_POS, 1000},      \
-  {HF_L, PART_ELBOW_X_ROT, 1200, 1000},                  \
-  {HF_R, PART_SHOULDER_X_ROT, INVALID_BODY_POS, 1000},   \
-  {HF_R, PART_SHOULDER_X_ROT, 900, 1000},                \
-  {HF_L, PART_SHOULDER_X_ROT, INVALID_BODY_POS, 1000},   \
-  {HF_L, PART_SHOULDER_X_ROT, 900, 1000},                \
-  {HF_R, PART_ANKLE_X_ROT, INVALID_BODY_POS, 4000},      \
-  {HF_R, PART_ANKLE_Y_ROT, INVALID_BODY_POS, 1000},      \
-  {HF_R, PART_KNEE_X_ROT, INVALID_BODY_POS, 1000},       \
-  {HF_R, PART_HIP_Y_ROT, INVALID_BODY_POS, 1000},        \
-  {HF_R, PART_ELBOW_Z_ROT, INVALID_BODY_POS, 3000},      \
-  {HF_R, PART_ELBOW_X_ROT, INVALID_BODY_POS, 1000},      \
-  {HF_L, PART_ANKLE_X_ROT, INVALID_BODY_POS, 4000},      \
-  {HF_L, PART_ANKLE_Y_ROT, INVALID_BODY_POS, 1000},      \
-  {HF_L, PART_KNEE_X_ROT, INVALID_BODY_POS, 1000},       \
-  {HF_L, PART_HIP_Y_ROT, INVALID_BODY_POS, 1000},        \
-  {HF_L, PART_ELBOW_Z_ROT, INVALID_BODY_POS, 3000},      \
-  {HF_L, PART_ELBOW_X_ROT, INVALID_BODY_POS, 1000},      \
-}
-#define ANIM_HR_STEPS {                                  \
-  {HF_R, PART_SHOULDER_X_ROT, 1600, 1000},               \
-  {HF_R, PART_SHOULDER_Y_ROT, 400, 1000},                \
-  {HF_R, PART_ELBOW_Z_ROT, 900, 1000},                   \
-  {HF_R, PART_ELBOW_X_ROT, 400, 1000},                   \
-  {HF_R, PART_ELBOW_Z_ROT, INVALID_BODY_POS, 1000},      \
-                                                         \
-  {HF_R, PART_ELBOW_Z_ROT, 500, 1000},                   \
-  {HF_R, PART_ELBOW_Z_ROT, 1300, 1000},                  \
+// Steps are packed: a header byte with the half, the wait flag and the part,
+// followed by 24 bits with the time in ms and the angle*10 of a move, 13 and
+// 11 bits, or by the 16 bit time of a wait. Multibyte values are little endian
+// and a step is fetched with a single memcpy_P of ANIM_STEP_FETCH bytes.
+#define ANIM_STEP_HALF         0x80
+#define ANIM_STEP_WAIT         0x40
+#define ANIM_STEP_PART         0x0F
+#define ANIM_STEP_TIME_BITS      13
+#define ANIM_STEP_TIME_MASK  0x1FFF     // Longest move, 8191ms.
+#define ANIM_STEP_MOVE_SIZE       4
+#define ANIM_STEP_WAIT_SIZE       3
+#define ANIM_STEP_FETCH           4
+
+#define ANIM_MOVE(_half, _part, _angle, _time)                                 \
+  ((_half) ? ANIM_STEP_HALF : 0) | (_part), (_time) & 0xFF,                    \
+  (((_time) >> 8) & 0x1F) | (((_angle) & 0x07) << 5), (_angle) >> 3
+#define ANIM_WAIT(_half, _part, _time)                                         \
+  ((_half) ? ANIM_STEP_HALF : 0) | ANIM_STEP_WAIT | (_part), (_time) & 0xFF,   \
+  (_time) >> 8
+
+// EEPROM directory, one entry of ANIM_EE_ENTRY bytes for each slot, followed
+// by the steps. A slot is empty while the high byte of its offset is
+// ANIM_EE_EMPTY, as on an erased EEPROM, so a single byte write empties or
+// fills it. The last byte is left as padding, see ANIM_STEP_FETCH.
+#define ANIM_EE_OFFSET            0     // First byte of the steps, 16 bits.
+#define ANIM_EE_BYTES             2     // Bytes of the steps, 16 bits.
+#define ANIM_EE_START             4
+#define ANIM_EE_LOOP              5
+#define ANIM_EE_END               6
+#define ANIM_EE_ENTRY             8
+#define ANIM_EE_EMPTY          0xFF
+#define ANIM_EE_DATA            (ANIM_EE_SLOTS * ANIM_EE_ENTRY)
+#define ANIM_EE_DIR_ADDR(_slot) ((_slot) * ANIM_EE_ENTRY)
+#define ANIM_EE_LIMIT            E2END  // First byte after the steps.
+#define ANIM_EE_MAX_STEPS       255
+
+#define ANIM_SIT_OFFSET           0
+#define ANIM_HR_OFFSET          196
+#define ANIM_FOR_OFFSET         223
+#define ANIM_STEPS_BYTES        289     // With the padding byte.
+
+// Animation directory, indexed by the animation id: the byte where the steps
+// of each animation start in ANIM_STEPS and how many of them are played once at the
+// start, looped and played once at the end.
+#define ANIM_DIRECTORY {                                                       \
+  {ANIM_GAIT, GAIT_START_STEPS, GAIT_LOOP_STEPS, GAIT_END_STEPS},              \
+  {ANIM_GAIT, GAIT_START_STEPS, GAIT_LOOP_STEPS, GAIT_END_STEPS},              \
+  {ANIM_GAIT, GAIT_START_STEPS, GAIT_LOOP_STEPS, GAIT_END_STEPS},              \
+  {ANIM_GAIT, GAIT_START_STEPS, GAIT_LOOP_STEPS, GAIT_END_STEPS},              \
+  {ANIM_GAIT, GAIT_START_STEPS, GAIT_LOOP_STEPS, GAIT_END_STEPS},              \
+  {ANIM_GAIT, GAIT_START_STEPS, GAIT_LOOP_STEPS, GAIT_END_STEPS},              \
+  {ANIM_GAIT, GAIT_START_STEPS, GAIT_LOOP_STEPS, GAIT_END_STEPS},              \
+  {ANIM_GAIT, GAIT_START_STEPS, GAIT_LOOP_STEPS, GAIT_END_STEPS},              \
+  {ANIM_SIT_OFFSET, 56, 0, 0},                                                 \
+  {ANIM_HR_OFFSET, 5, 2, 0},                                                   \
+  {ANIM_FOR_OFFSET, 8, 9, 0}                                                   \
 }
-#define ANIM_FOR_STEPS {                                 \
-  {HF_R, PART_SHOULDER_X_ROT, 1500, 1000},               \
-  {HF_L, PART_SHOULDER_X_ROT, 1500, 1000},               \
-  {HF_L, PART_SHOULDER_Y_ROT, 0, 1000},                  \
-  {HF_R, PART_SHOULDER_Y_ROT, 100, 1000},                \
-  {HF_R, PART_ELBOW_Z_ROT, 600, 1000},                   \
-  {HF_L, PART_ELBOW_Z_ROT, 0, 1000},                     \
-  {HF_R, PART_ELBOW_X_ROT, 600, 1000},                   \
-  {HF_L, PART_ELBOW_X_ROT, 400, 1000},                   \
-  {HF_R, PART_SHOULDER_X_ROT, INVALID_BODY_POS, 1000},   \
-  {HF_R, PART_SHOULDER_X_ROT, 1800, 500},                \
-  {HF_L, PART_ELBOW_Z_ROT, INVALID_BODY_POS, 1250},      \
-  {HF_L, PART_ELBOW_Z_ROT, 500, 250},                    \
-  {HF_R, PART_ELBOW_X_ROT, INVALID_BODY_POS, 1250},      \
-  {HF_R, PART_ELBOW_X_ROT, 400, 250},                    \
-  {HF_R, PART_SHOULDER_X_ROT, 1500, 500},                \
-  {HF_L, PART_ELBOW_Z_ROT, 0, 500},                      \
-  {HF_R, PART_ELBOW_X_ROT, 600, 500},                    \
+
+// Steps of all the stored animations, back to back, as generated by
+// AnimHelper. A wait is a pause of its bodypart.
+#define ANIM_STEPS {                                                           \
+  /* ANIM_SIT, 56 steps. */                                                    \
+  ANIM_MOVE(HF_R, PART_ANKLE_X_ROT, 950, 1000),                                \
+  ANIM_MOVE(HF_L, PART_ANKLE_X_ROT, 950, 1000),                                \
+  ANIM_MOVE(HF_R, PART_ANKLE_Y_ROT, 1800, 1000),                               \
+  ANIM_MOVE(HF_L, PART_ANKLE_Y_ROT, 1800, 1000),                               \
+  ANIM_MOVE(HF_L, PART_KNEE_X_ROT, 0, 1000),                                   \
+  ANIM_MOVE(HF_R, PART_KNEE_X_ROT, 0, 1000),                                   \
+  ANIM_MOVE(HF_R, PART_HIP_Y_ROT, 500, 1000),                                  \
+  ANIM_MOVE(HF_L, PART_HIP_Y_ROT, 500, 1000),                                  \
+  ANIM_WAIT(HF_L, PART_SHOULDER_X_ROT, 1000),                                  \
+  ANIM_MOVE(HF_L, PART_SHOULDER_X_ROT, 500, 1000),                             \
+  ANIM_WAIT(HF_R, PART_SHOULDER_X_ROT, 1000),                                  \
+  ANIM_MOVE(HF_R, PART_SHOULDER_X_ROT, 500, 1000),                             \
+  ANIM_WAIT(HF_L, PART_ELBOW_Z_ROT, 1000),                                     \
+  ANIM_MOVE(HF_L, PART_ELBOW_Z_ROT, 500, 1000),                                \
+  ANIM_WAIT(HF_R, PART_ELBOW_Z_ROT, 1000),                                     \
+  ANIM_MOVE(HF_R, PART_ELBOW_Z_ROT, 500, 1000),                                \
+  ANIM_WAIT(HF_L, PART_ELBOW_X_ROT, 1000),                                     \
+  ANIM_MOVE(HF_L, PART_ELBOW_X_ROT, 1500, 1000),                               \
+  ANIM_WAIT(HF_R, PART_ELBOW_X_ROT, 1000),                                     \
+  ANIM_MOVE(HF_R, PART_ELBOW_X_ROT, 1500, 1000),                               \
+  ANIM_WAIT(HF_R, PART_HIP_Y_ROT, 1000),                                       \
+  ANIM_MOVE(HF_R, PART_HIP_Y_ROT, 1000, 1000),                                 \
+  ANIM_WAIT(HF_L, PART_HIP_Y_ROT, 1000),                                       \
+  ANIM_MOVE(HF_L, PART_HIP_Y_ROT, 1000, 1000),                                 \
+  ANIM_MOVE(HF_L, PART_SHOULDER_X_ROT, 0, 1000),                               \
+  ANIM_MOVE(HF_R, PART_SHOULDER_X_ROT, 0, 1000),                               \
+  ANIM_WAIT(HF_R, PART_ANKLE_Y_ROT, 2000),                                     \
+  ANIM_MOVE(HF_R, PART_ANKLE_Y_ROT, 1200, 1000),                               \
+  ANIM_WAIT(HF_L, PART_ANKLE_Y_ROT, 2000),                                     \
+  ANIM_MOVE(HF_L, PART_ANKLE_Y_ROT, 1200, 1000),                               \
+  ANIM_WAIT(HF_L, PART_KNEE_X_ROT, 2000),                                      \
+  ANIM_MOVE(HF_L, PART_KNEE_X_ROT, 1400, 1000),                                \
+  ANIM_WAIT(HF_R, PART_KNEE_X_ROT, 2000),                                      \
+  ANIM_MOVE(HF_R, PART_KNEE_X_ROT, 1400, 1000),                                \
+  ANIM_MOVE(HF_R, PART_HIP_Y_ROT, 100, 1000),                                  \
+  ANIM_MOVE(HF_L, PART_HIP_Y_ROT, 0, 1000),                                    \
+  ANIM_WAIT(HF_R, PART_ELBOW_X_ROT, 1000),                                     \
+  ANIM_MOVE(HF_R, PART_ELBOW_X_ROT, 1200, 1000),                               \
+  ANIM_WAIT(HF_L, PART_ELBOW_X_ROT, 1000),                                     \
+  ANIM_MOVE(HF_L, PART_ELBOW_X_ROT, 1200, 1000),                               \
+  ANIM_WAIT(HF_R, PART_SHOULDER_X_ROT, 1000),                                  \
+  ANIM_MOVE(HF_R, PART_SHOULDER_X_ROT, 900, 1000),                             \
+  ANIM_WAIT(HF_L, PART_SHOULDER_X_ROT, 1000),                                  \
+  ANIM_MOVE(HF_L, PART_SHOULDER_X_ROT, 900, 1000),                             \
+  ANIM_WAIT(HF_R, PART_ANKLE_X_ROT, 4000),                                     \
+  ANIM_WAIT(HF_R, PART_ANKLE_Y_ROT, 1000),                                     \
+  ANIM_WAIT(HF_R, PART_KNEE_X_ROT, 1000),                                      \
+  ANIM_WAIT(HF_R, PART_HIP_Y_ROT, 1000),                                       \
+  ANIM_WAIT(HF_R, PART_ELBOW_Z_ROT, 3000),                                     \
+  ANIM_WAIT(HF_R, PART_ELBOW_X_ROT, 1000),                                     \
+  ANIM_WAIT(HF_L, PART_ANKLE_X_ROT, 4000),                                     \
+  ANIM_WAIT(HF_L, PART_ANKLE_Y_ROT, 1000),                                     \
+  ANIM_WAIT(HF_L, PART_KNEE_X_ROT, 1000),                                      \
+  ANIM_WAIT(HF_L, PART_HIP_Y_ROT, 1000),                                       \
+  ANIM_WAIT(HF_L, PART_ELBOW_Z_ROT, 3000),                                     \
+  ANIM_WAIT(HF_L, PART_ELBOW_X_ROT, 1000),                                     \
+  /* ANIM_HR, 5 + 2 steps. */                                                  \
+  ANIM_MOVE(HF_R, PART_SHOULDER_X_ROT, 1600, 1000),                            \
+  ANIM_MOVE(HF_R, PART_SHOULDER_Y_ROT, 400, 1000),                             \
+  ANIM_MOVE(HF_R, PART_ELBOW_Z_ROT, 900, 1000),                                \
+  ANIM_MOVE(HF_R, PART_ELBOW_X_ROT, 400, 1000),                                \
+  ANIM_WAIT(HF_R, PART_ELBOW_Z_ROT, 1000),                                     \
+  ANIM_MOVE(HF_R, PART_ELBOW_Z_ROT, 500, 1000),                                \
+  ANIM_MOVE(HF_R, PART_ELBOW_Z_ROT, 1300, 1000),                               \
+  /* ANIM_FOR, 8 + 9 steps. */                                                 \
+  ANIM_MOVE(HF_R, PART_SHOULDER_X_ROT, 1500, 1000),                            \
+  ANIM_MOVE(HF_L, PART_SHOULDER_X_ROT, 1500, 1000),                            \
+  ANIM_MOVE(HF_L, PART_SHOULDER_Y_ROT, 0, 1000),                               \
+  ANIM_MOVE(HF_R, PART_SHOULDER_Y_ROT, 100, 1000),                             \
+  ANIM_MOVE(HF_R, PART_ELBOW_Z_ROT, 600, 1000),                                \
+  ANIM_MOVE(HF_L, PART_ELBOW_Z_ROT, 0, 1000),                                  \
+  ANIM_MOVE(HF_R, PART_ELBOW_X_ROT, 600, 1000),                                \
+  ANIM_MOVE(HF_L, PART_ELBOW_X_ROT, 400, 1000),                                \
+  ANIM_WAIT(HF_R, PART_SHOULDER_X_ROT, 1000),                                  \
+  ANIM_MOVE(HF_R, PART_SHOULDER_X_ROT, 1800, 500),                             \
+  ANIM_WAIT(HF_L, PART_ELBOW_Z_ROT, 1250),                                     \
+  ANIM_MOVE(HF_L, PART_ELBOW_Z_ROT, 500, 250),                                 \
+  ANIM_WAIT(HF_R, PART_ELBOW_X_ROT, 1250),                                     \
+  ANIM_MOVE(HF_R, PART_ELBOW_X_ROT, 400, 250),                                 \
+  ANIM_MOVE(HF_R, PART_SHOULDER_X_ROT, 1500, 500),                             \
+  ANIM_MOVE(HF_L, PART_ELBOW_Z_ROT, 0, 500),                                   \
+  ANIM_MOVE(HF_R, PART_ELBOW_X_ROT, 600, 500),                                 \
+  0                                   /* Padding, see ANIM_STEP_FETCH. */      \
 }
 
 struct anim_t {
   bool busyAnimation, endingAnimation;
   uint8_t activeAnimation, stepAnimation,
           startAnimation, loopAnimation, endAnimation;
+  uint16_t offsetAnimation;
+  bool eepromAnimation;               // Steps are read from the EEPROM.
+  uint16_t readOffset, loopOffset;    // Bytes of the next and the loop step.
   uint16_t distAnimation, timeAnimation, angleAnimation;
+  uint16_t timeScale, angleScale;     // Q8, see ANIM_SCALE_BITS.
+  uint16_t loopKeyframe;
 };
 
-typedef const PROGMEM uint8_t steps_size_t;
-typedef const PROGMEM uint16_t steps_info_t;
+struct anim_compact_t {
+  bool pending;                       // Some steps may have to be moved down.
+  uint8_t slot;                       // ANIM_NULL if none is being moved.
+  uint16_t offset;                    // New first byte of the slot.
+  uint16_t from, to, end;             // Next byte to read and to write.
+};
+
+struct anim_upload_t {
+  uint8_t slot;                       // ANIM_NULL if no upload is open.
+  uint8_t start, loop, end;
+  uint8_t steps;                      // Steps sent.
+  uint16_t offset, writeOffset;       // First and next byte of the steps.
+  uint8_t step[ANIM_STEP_MOVE_SIZE];  // Packed step being written.
+  uint8_t size, written;              // Bytes of the step and written.
+  uint8_t closing;                    // Directory byte being written, or 0.
+};
+
+typedef const PROGMEM uint16_t anim_dir_t;
+struct anim_timing_t {
+  uint16_t steps;
+  uint32_t sumTicks, maxTicks;
+};
+
+typedef const PROGMEM uint8_t steps_info_t;
 
 class AnimationStore {
   public:
@@ -264,37 +283,50 @@ class AnimationStore {
     static void applyAnimation(uint8_t _anim, uint16_t _dist,
                                uint16_t _time, uint16_t _angle = 0);
     static void clearAnimation(bool _force = false);
+    static void setAmplitude(uint16_t _scale);
     static void executeAnimation();
+    static void printTiming();
+    static void clearTiming();
+
+    static bool beginUpload(uint8_t _slot, uint8_t _start, uint8_t _loop,
+                            uint8_t _end);
+    static bool uploadStep(bool _half, uint8_t _idx, uint16_t _angle,
+                           uint16_t _time);
+    static bool endUpload();
+    static bool deleteAnimation(uint8_t _slot);
+    static bool isWriting();
+    static void compactRoutine();
+    static uint16_t getFree();
+    static void printStored();
   private:
     // No-one have to create an istance of this class as we use it as
     // a singleton, so we keep constructor as private.
     AnimationStore();
 
-    static void nextStep(bool &_half, uint8_t &_idx, uint16_t &_angle, uint16_t &_time);
-    static void nextStepFWW(bool &_half, uint8_t &_idx, uint16_t &_angle, uint16_t &_time);
-    static void nextStepBWW(bool &_half, uint8_t &_idx, uint16_t &_angle, uint16_t &_time);
-    static void nextStepSWR(bool &_half, uint8_t &_idx, uint16_t &_angle, uint16_t &_time);
-    static void nextStepSWL(bool &_half, uint8_t &_idx, uint16_t &_angle, uint16_t &_time);
-    static void nextStepCWSR(bool &_half, uint8_t &_idx, uint16_t &_angle, uint16_t &_time);
-    static void nextStepCCWSR(bool &_half, uint8_t &_idx, uint16_t &_angle, uint16_t &_time);
-    static void nextStepCWCW(bool &_half, uint8_t &_idx, uint16_t &_angle, uint16_t &_time);
-    static void nextStepCCWCW(bool &_half, uint8_t &_idx, uint16_t &_angle, uint16_t &_time);
-    static void nextStepSIT(bool &_half, uint8_t &_idx, uint16_t &_angle, uint16_t &_time);
-    static void nextStepHR(bool &_half, uint8_t &_idx, uint16_t &_angle, uint16_t &_time);
-    static void nextStepFOR(bool &_half, uint8_t &_idx, uint16_t &_angle, uint16_t &_time);
+    static bool nextStep(bool &_half, uint8_t &_idx, uint16_t &_angle, uint16_t &_time);
+    static void alignKeyframes();
+    static void raw_endAnimation();
+    static void raw_readStep(bool &_half, uint8_t &_idx, uint16_t &_angle,
+                             uint16_t &_time);
+    static void raw_scaleStep(const uint8_t &_idx, uint16_t &_angle,
+                              uint16_t &_time);
+    static uint16_t raw_bakedLength();
+    static uint16_t raw_entry(const uint8_t &_slot, const uint8_t &_field);
+    static bool raw_isEmpty(const uint8_t &_slot);
+    static uint16_t raw_usedEnd();
+    static uint16_t raw_usedBytes();
+    static void raw_nextMove();
+    static void raw_closeUpload();
+    static uint8_t *raw_eeprom(const uint16_t &_addr);
     static anim_t anim;
-    static steps_size_t steps_size[ANIM_SIZE][3];
-    static steps_info_t steps_FWW[ANIM_FWW_SIZE][4];
-    static steps_info_t steps_BWW[ANIM_BWW_SIZE][4];
-    static steps_info_t steps_SWR[ANIM_SWR_SIZE][4];
-    static steps_info_t steps_SWL[ANIM_SWL_SIZE][4];
-    static steps_info_t steps_CWSR[ANIM_CWSR_SIZE][4];
-    static steps_info_t steps_CCWSR[ANIM_CCWSR_SIZE][4];
-    static steps_info_t steps_CWCW[ANIM_CWCW_SIZE][4];
-    static steps_info_t steps_CCWCW[ANIM_CCWCW_SIZE][4];
-    static steps_info_t steps_SIT[ANIM_SIT_SIZE][4];
-    static steps_info_t steps_HR[ANIM_HR_SIZE][4];
-    static steps_info_t steps_FOR[ANIM_FOR_SIZE][4];
+    static uint16_t keyframe[HF_SIZE][HF_NUM];
+    static anim_dir_t directory[ANIM_SIZE][ANIM_DIR_SIZE];
+    static steps_info_t steps[ANIM_STEPS_BYTES];
+    static anim_upload_t upload;
+    static anim_compact_t compact;
+#if SERIAL_SERVO_TIMING
+    static anim_timing_t timing;
+#endif
 };
 
 #endif
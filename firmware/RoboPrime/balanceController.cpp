@@ -0,0 +1,225 @@
+/**
+ * Part of RoboPrime Firmware.
+ *
+ * BalanceController.cpp
+ * Closed loop balance of the trunk.
+ *
+ * RoboPrime Firmware, (https://github.com/simonepri/RoboPrime)
+ * Copyright (c) 2015, Simone Primarosa, (https://simoneprimarosa.com)
+ *
+ * Licensed under The MIT License
+ * Redistribution of file must retain the above copyright notice.
+ *
+ * @copyright     Copyright (c) 2015, Simone Primarosa, (https://simoneprimarosa.com)
+ * @link          (https://github.com/simonepri/RoboPrime)
+ * @since         0.0.0
+ * @require       SerialServo, BodyMovement, BodyKinematics, MotionSensor
+ * @license       MIT License (https://opensource.org/licenses/MIT)
+ */
+
+#include "Arduino.h"
+#include "serialServo.h"
+#include "bodyMovement.h"
+#include "bodyKinematics.h"
+#include "motionSensor.h"
+
+#include "balanceController.h"
+
+/**
+ * balance struct is located in SRAM momery and store the gains, the reference
+ * attitude and the state of the controller.
+ */
+balance_t
+  BalanceController::balance;
+
+#if SERIAL_SERVO_TIMING
+/**
+ * timing struct is located in SRAM momery and store how long the updates took.
+ */
+balance_timing_t
+  BalanceController::timing;
+#endif
+
+/**
+ * Initializes class's fields, the balance starts disabled.
+ */
+void BalanceController::begin() {
+  balance.enabled = false;
+  balance.referenced = false;
+  balance.gain[BALANCE_GAIN_P] = BALANCE_KP;
+  balance.gain[BALANCE_GAIN_D] = BALANCE_KD;
+  balance.gain[BALANCE_GAIN_HIP] = BALANCE_HIP;
+  balance.lastUpdate = SerialServo::readClock();
+  clearTiming();
+}
+
+/**
+ * Corrects the legs once every BALANCE_PERIOD_MS while the balance is enabled.
+ * The first attitude read after enabling is the reference, no correction is
+ * applied until the sensor is ready. If the sensor stops being ready, e.g. on
+ * bus errors, the corrections are removed and a new reference is taken once
+ * it is ready again.
+ */
+void BalanceController::balanceRoutine() {
+  if(!balance.enabled) {
+    return;
+  }
+  uint32_t _now = SerialServo::readClock();
+  if(_now - balance.lastUpdate < msToTicks(BALANCE_PERIOD_MS)) {
+    return;
+  }
+  balance.lastUpdate = _now;
+  if(!MotionSensor::isReady()) {
+    if(balance.referenced) {
+      raw_correct(0, 0);
+      balance.referenced = false;
+    }
+    return;
+  }
+  if(!balance.referenced) {
+    balance.refPitch = MotionSensor::getPitch();
+    balance.refRoll = MotionSensor::getRoll();
+    balance.lastPitch = balance.lastRoll = 0;
+    balance.referenced = true;
+  }
+  int16_t _pitch = MotionSensor::getPitch() - balance.refPitch;
+  int16_t _roll = MotionSensor::getRoll() - balance.refRoll;
+  raw_correct(raw_control(_pitch, balance.lastPitch),
+              raw_control(_roll, balance.lastRoll));
+  balance.lastPitch = _pitch;
+  balance.lastRoll = _roll;
+#if SERIAL_SERVO_TIMING
+  uint32_t _ticks = SerialServo::readClock() - _now;
+  timing.updates++;
+  timing.sumTicks += _ticks;
+  if(_ticks > timing.maxTicks) {
+    timing.maxTicks = _ticks;
+  }
+#endif
+}
+
+/**
+ * Enables or disables the balance. Enabling takes a new reference attitude,
+ * disabling removes the corrections.
+ *
+ * @param _enabled true to enable the balance.
+ */
+void BalanceController::setEnabled(bool _enabled) {
+  if(_enabled == balance.enabled) {
+    return;
+  }
+  balance.enabled = _enabled;
+  balance.referenced = false;
+  if(!_enabled) {
+    raw_correct(0, 0);
+  }
+}
+
+/**
+ * Sets a gain of the controller, all gains are Q8:
+ *  - BALANCE_GAIN_P is the correction for each angle*10 of error.
+ *  - BALANCE_GAIN_D is the correction for each angle*10 the error grew since
+ *    the previous update.
+ *  - BALANCE_GAIN_HIP is the share of the correction given to the hips, up to
+ *    1, the ankles take the rest.
+ *
+ * @param _gain gain index, see BALANCE_GAIN_*.
+ * @param _value gain value.
+ */
+void BalanceController::setGain(uint8_t _gain, uint16_t _value) {
+  if(_gain >= BALANCE_GAINS) {
+    return;
+  }
+  if(_gain == BALANCE_GAIN_HIP && _value > (1 << BALANCE_FRACT_BITS)) {
+    _value = 1 << BALANCE_FRACT_BITS;
+  }
+  balance.gain[_gain] = _value;
+}
+
+/**
+ * Checks if the balance is enabled.
+ *
+ * @return true if the balance is enabled.
+ */
+bool BalanceController::isEnabled() {
+  return balance.enabled;
+}
+
+/**
+ * Prints the update time statistics as E <updates> <average us> <max us>.
+ * Nothing is printed unless SERIAL_SERVO_TIMING is enabled.
+ */
+void BalanceController::printTiming() {
+#if SERIAL_SERVO_TIMING
+  Serial.print('E');
+  Serial.print(' ');
+  Serial.print(timing.updates);
+  Serial.print(' ');
+  Serial.print(timing.updates ? ticksToUs(timing.sumTicks / timing.updates) : 0);
+  Serial.print(' ');
+  Serial.print(ticksToUs(timing.maxTicks));
+  Serial.println();
+#endif
+}
+
+/**
+ * Clears the update time statistics.
+ */
+void BalanceController::clearTiming() {
+#if SERIAL_SERVO_TIMING
+  timing.updates = 0;
+  timing.sumTicks = 0;
+  timing.maxTicks = 0;
+#endif
+}
+
+/**
+ * Computes the correction of an axis.
+ *
+ * @param _error angle*10 from the reference.
+ * @param _last error of the previous update.
+ * @return correction in angle*10, within BALANCE_MAX.
+ */
+inline int16_t BalanceController::raw_control(const int16_t &_error,
+                                              const int16_t &_last) {
+  int32_t _out = (int32_t(balance.gain[BALANCE_GAIN_P]) * _error +
+                  int32_t(balance.gain[BALANCE_GAIN_D]) * (_error - _last)) >>
+                 BALANCE_FRACT_BITS;
+  if(_out > BALANCE_MAX) {
+    return BALANCE_MAX;
+  }
+  if(_out < -BALANCE_MAX) {
+    return -BALANCE_MAX;
+  }
+  return _out;
+}
+
+/**
+ * Trims the ankles and the hips of both legs.
+ * A positive pitch leans the trunk forward: the ankles tilt the legs back and
+ * the hips tilt the trunk back. A positive roll leans it to the left: the
+ * ankles tilt the legs and the hips the trunk to the right. Roll joints are
+ * mirrored on the left half, see BodyKinematics.
+ *
+ * @param _pitch pitch correction in angle*10.
+ * @param _roll roll correction in angle*10.
+ */
+inline void BalanceController::raw_correct(const int16_t &_pitch,
+                                           const int16_t &_roll) {
+  uint16_t _share = balance.gain[BALANCE_GAIN_HIP];
+  int16_t _hipPitch = (int32_t(_pitch) * _share) >> BALANCE_FRACT_BITS;
+  int16_t _hipRoll = (int32_t(_roll) * _share) >> BALANCE_FRACT_BITS;
+  int16_t _anklePitch = _pitch - _hipPitch;
+  int16_t _ankleRoll = _roll - _hipRoll;
+  for(uint8_t _half = HF_R; _half < HF_SIZE; _half++) {
+    int8_t _mirror = _half ? -1 : 1;
+    BodyMovement::setTrim(_half, PART_ANKLE_Y_ROT, -_anklePitch *
+                          BodyKinematics::getSign(PART_ANKLE_Y_ROT));
+    BodyMovement::setTrim(_half, PART_HIP_Y_ROT, _hipPitch *
+                          BodyKinematics::getSign(PART_HIP_Y_ROT));
+    BodyMovement::setTrim(_half, PART_ANKLE_X_ROT, _mirror * _ankleRoll *
+                          BodyKinematics::getSign(PART_ANKLE_X_ROT));
+    BodyMovement::setTrim(_half, PART_HIP_X_ROT, -_mirror * _hipRoll *
+                          BodyKinematics::getSign(PART_HIP_X_ROT));
+  }
+}
@@ -0,0 +1,88 @@
+/**
+ * Part of RoboPrime Firmware.
+ *
+ * BalanceController.h
+ * Closed loop balance of the trunk.
+ *
+ * RoboPrime Firmware, (https://github.com/simonepri/RoboPrime)
+ * Copyright (c) 2015, Simone Primarosa, (https://simoneprimarosa.com)
+ *
+ * Licensed under The MIT License
+ * Redistribution of file must retain the above copyright notice.
+ *
+ * @copyright     Copyright (c) 2015, Simone Primarosa, (https://simoneprimarosa.com)
+ * @link          (https://github.com/simonepri/RoboPrime)
+ * @since         0.0.0
+ * @require       SerialServo, BodyMovement, BodyKinematics, MotionSensor
+ * @license       MIT License (https://opensource.org/licenses/MIT)
+ */
+
+/*
+ * PURPOSE:
+ *
+ * This create a class that keeps the trunk at the attitude it had when the
+ * balance was enabled, by correcting the ankles and the hips of both legs.
+ * Once per servo frame the pitch and the roll errors given by MotionSensor go
+ * through a PD controller, the correction is shared between the ankles, which
+ * tilt the whole body, and the hips, which tilt the trunk over the legs, see
+ * BALANCE_HIP.
+ * Corrections are trims, see SerialServo::trimAngle: they are added to the
+ * pulses on top of whatever the queues and the animations command, so the
+ * planned movements are never changed.
+ * The controller is fixed point, gains are Q8 numbers, and an update is two
+ * multiplications per axis and 8 trims, well within a frame, see printTiming.
+ */
+
+#ifndef _BALANCE_CONTROLLER_H
+#define _BALANCE_CONTROLLER_H
+
+#define BALANCE_PERIOD_MS      20     // One update per servo frame.
+#define BALANCE_FRACT_BITS      8     // Gains are Q8.
+#define BALANCE_KP            128     // 0.5.
+#define BALANCE_KD            256     // 1 per update.
+#define BALANCE_HIP            64     // Share of the hips, 1/4.
+#define BALANCE_MAX           100     // Largest correction, angle*10.
+
+#define BALANCE_GAIN_P          0
+#define BALANCE_GAIN_D          1
+#define BALANCE_GAIN_HIP        2
+#define BALANCE_GAINS           3
+
+struct balance_t {
+  bool enabled;
+  bool referenced;                    // Reference attitude taken.
+  uint16_t gain[BALANCE_GAINS];
+  int16_t refPitch, refRoll;
+  int16_t lastPitch, lastRoll;        // Errors of the previous update.
+  uint32_t lastUpdate;
+};
+
+struct balance_timing_t {
+  uint16_t updates;
+  uint32_t sumTicks, maxTicks;
+};
+
+class BalanceController {
+  public:
+    static void begin();
+    static void balanceRoutine();
+    static void setEnabled(bool _enabled);
+    static void setGain(uint8_t _gain, uint16_t _value);
+    static bool isEnabled();
+    static void printTiming();
+    static void clearTiming();
+  private:
+    // No-one have to create an istance of this class as we use it as
+    // a singleton, so we keep constructor as private.
+    BalanceController();
+
+    static int16_t raw_control(const int16_t &_error, const int16_t &_last);
+    static void raw_correct(const int16_t &_pitch, const int16_t &_roll);
+
+    static balance_t balance;
+#if SERIAL_SERVO_TIMING
+    static balance_timing_t timing;
+#endif
+};
+
+#endif
@@ -0,0 +1,522 @@
+/**
+ * Part of RoboPrime Firmware.
+ *
+ * BodyKinematics.cpp
+ * Robot forward and inverse kinematics.
+ *
+ * RoboPrime Firmware, (https://github.com/simonepri/RoboPrime)
+ * Copyright (c) 2015, Simone Primarosa, (https://simoneprimarosa.com)
+ *
+ * Licensed under The MIT License
+ * Redistribution of file must retain the above copyright notice.
+ *
+ * @copyright     Copyright (c) 2015, Simone Primarosa, (https://simoneprimarosa.com)
+ * @link          (https://github.com/simonepri/RoboPrime)
+ * @since         0.0.0
+ * @require       SerialServo, BodyMovement
+ * @license       MIT License (https://opensource.org/licenses/MIT)
+ */
+
+#include "Arduino.h"
+#include "serialServo.h"
+#include "bodyMovement.h"
+
+#include "bodyKinematics.h"
+
+/**
+ * joint array is located in FLASH momery and store information about the
+ * rotation axis, the direction, and the length and mass of the link of each
+ * bodypart.
+ */
+kin_joint_t
+  BodyKinematics::joint[HF_NUM][KIN_SIZE] = KIN_JOINTS;
+
+/**
+ * sinTable array is located in FLASH momery and store the sine of each whole
+ * degree of the first quadrant.
+ */
+kin_sin_t
+  BodyKinematics::sinTable[KIN_SIN_SIZE] = KIN_SIN_TABLE;
+
+/**
+ * atanTable array is located in FLASH momery and store the arctangent of the
+ * tangents from 0 to 1 in steps of 1/32.
+ */
+kin_atan_t
+  BodyKinematics::atanTable[KIN_ATAN_SIZE] = KIN_ATAN_TABLE;
+
+/**
+ * foot, hand and com are located in SRAM momery and store the positions
+ * computed by the last update.
+ */
+kin_point_t
+  BodyKinematics::foot[HF_SIZE],
+  BodyKinematics::hand[HF_SIZE],
+  BodyKinematics::com;
+
+/**
+ * lastUpdate is located in SRAM momery and store the SerialServo clock value
+ * of the last update.
+ */
+uint32_t
+  BodyKinematics::lastUpdate;
+
+#if SERIAL_SERVO_TIMING
+/**
+ * timing is located in SRAM momery and store how long the updates took.
+ */
+kin_timing_t
+  BodyKinematics::timing;
+#endif
+
+/**
+ * Initializes class's fields.
+ */
+void BodyKinematics::begin() {
+  lastUpdate = SerialServo::readClock();
+  clearTiming();
+  update();
+}
+
+/**
+ * Updates the positions once every KIN_PERIOD_MS.
+ */
+void BodyKinematics::kinematicsRoutine() {
+  uint32_t _now = SerialServo::readClock();
+  if(_now - lastUpdate < msToTicks(KIN_PERIOD_MS)) {
+    return;
+  }
+  lastUpdate = _now;
+  update();
+#if SERIAL_SERVO_TIMING
+  uint32_t _ticks = SerialServo::readClock() - _now;
+  timing.updates++;
+  timing.sumTicks += _ticks;
+  if(_ticks > timing.maxTicks) {
+    timing.maxTicks = _ticks;
+  }
+#endif
+}
+
+/**
+ * Computes the position of the feet, of the hands and of the COM from the
+ * actual angle of the bodyparts.
+ */
+void BodyKinematics::update() {
+  kin_chain_t _body = {0, 0, 0, 0, 0, int32_t(KIN_TRUNK_MASS) * KIN_TRUNK_Z,
+                       KIN_TRUNK_MASS};
+  for(uint8_t _half = HF_R; _half < HF_SIZE; _half++) {
+    raw_limb(_half, PART_ANKLE_X_ROT, PART_HIP_Z_ROT, KIN_HIP_X, 0,
+             foot[_half], _body);
+    raw_limb(_half, PART_ELBOW_X_ROT, PART_SHOULDER_X_ROT, KIN_SHOULDER_X,
+             KIN_SHOULDER_Z, hand[_half], _body);
+  }
+  com.x = _body.mx * 10 / _body.mass;
+  com.y = _body.my * 10 / _body.mass;
+  com.z = _body.mz * 10 / _body.mass;
+}
+
+/**
+ * Gets the position of a foot, that is the middle of its sole.
+ *
+ * @param _half right or left body part.
+ * @return position in mm*10.
+ */
+kin_point_t BodyKinematics::getFoot(bool _half) {
+  return foot[_half];
+}
+
+/**
+ * Gets the position of a hand, that is the end of its forearm.
+ *
+ * @param _half right or left body part.
+ * @return position in mm*10.
+ */
+kin_point_t BodyKinematics::getHand(bool _half) {
+  return hand[_half];
+}
+
+/**
+ * Gets the position of the center of mass of the whole body.
+ *
+ * @return position in mm*10.
+ */
+kin_point_t BodyKinematics::getCom() {
+  return com;
+}
+
+/**
+ * Gets the direction of a bodypart joint: a positive angle of the model is a
+ * larger angle of the bodypart if it is 1, a smaller one if it is -1.
+ *
+ * @param _idx body part index.
+ * @return 1 or -1.
+ */
+int8_t BodyKinematics::getSign(uint8_t _idx) {
+  return pgm_read_byte_near(&(joint[_idx][KIN_SIGN]));
+}
+
+/**
+ * Computes the sine of an angle.
+ *
+ * @param _angle angle*10, between -3600 and 3600.
+ * @return sine in Q2.14, see KIN_ONE.
+ */
+int16_t BodyKinematics::sine(int16_t _angle) {
+  bool _negative = _angle < 0;
+  uint16_t _deg = _negative ? -_angle : _angle;
+  if(_deg >= 1800) {
+    _deg -= 1800;
+    _negative = !_negative;
+  }
+  if(_deg > 900) {
+    _deg = 1800 - _deg;
+  }
+  // Divides by 10 with a multiplication, it's exact up to 900.
+  uint8_t _idx = (uint32_t(_deg) * KIN_SIN_DIV10) >> 16;
+  uint8_t _tenth = _deg - _idx * 10;
+  int16_t _sin = pgm_read_word_near(&(sinTable[_idx]));
+  if(_tenth) {
+    int16_t _step = pgm_read_word_near(&(sinTable[_idx + 1])) - _sin;
+    _sin += (uint32_t(_step * _tenth) * KIN_SIN_DIV10) >> 16;
+  }
+  return _negative ? -_sin : _sin;
+}
+
+/**
+ * Computes the cosine of an angle.
+ *
+ * @param _angle angle*10, between -3600 and 2700.
+ * @return cosine in Q2.14, see KIN_ONE.
+ */
+int16_t BodyKinematics::cosine(int16_t _angle) {
+  return sine(_angle + 900);
+}
+
+/**
+ * Computes the angle of a vector, as atan2 does.
+ *
+ * @param _y component 90 degrees ahead of the one the angle starts from.
+ * @param _x component the angle starts from.
+ * @return angle*10, between -1800 and 1800.
+ */
+int16_t BodyKinematics::arctan(int32_t _y, int32_t _x) {
+  uint32_t _ay = _y < 0 ? -_y : _y;
+  uint32_t _ax = _x < 0 ? -_x : _x;
+  bool _swap = _ay > _ax;
+  uint32_t _min = _swap ? _ax : _ay;
+  uint32_t _max = _swap ? _ay : _ax;
+  if(!_max) {
+    return 0;
+  }
+  while(_max > 0xFFFF) {
+    _min >>= 1;
+    _max >>= 1;
+  }
+  uint32_t _tan = (_min << 16) / _max;
+  uint8_t _idx = _tan >> KIN_ATAN_SHIFT;
+  uint16_t _part = _tan & ((1 << KIN_ATAN_SHIFT) - 1);
+  int16_t _angle = pgm_read_word_near(&(atanTable[_idx]));
+  if(_part) {
+    uint16_t _step = pgm_read_word_near(&(atanTable[_idx + 1])) - _angle;
+    _angle += (_step * _part + (1 << (KIN_ATAN_SHIFT - 1))) >> KIN_ATAN_SHIFT;
+  }
+  if(_swap) {
+    _angle = 900 - _angle;
+  }
+  if(_x < 0) {
+    _angle = 1800 - _angle;
+  }
+  return _y < 0 ? -_angle : _angle;
+}
+
+/**
+ * Computes the angles that bring a foot to a position, with the sole parallel
+ * to the ground and turned by an angle. The leg is solved as a right one and
+ * mirrored on X if it is a left one.
+ * The hip yaw turns the foot, the hip roll leans the leg toward the foot, the
+ * hip pitch and the knee close the triangle made by the thigh and the shin and
+ * the ankle takes back the roll and the pitch to keep the sole flat.
+ *
+ * @param _half right or left body part.
+ * @param _foot position of the middle of the sole from the hip, in mm*10.
+ * @param _yaw angle*10 of the foot, positive turns the toes outward.
+ * @param _angles angles of the bodyparts from PART_ANKLE_X_ROT to
+ *                PART_HIP_Z_ROT as taken by setPos, filled.
+ * @return true if the position is reached, false if it is out of reach or out
+ *         of the angle limits and _angles are the nearest ones.
+ */
+bool BodyKinematics::solveLeg(bool _half, kin_point_t _foot, int16_t _yaw,
+                              uint16_t *_angles) {
+  bool _reached = true;
+  int32_t _x = _half ? -_foot.x : _foot.x;
+  int32_t _y = _foot.y;
+  int32_t _z = _foot.z;
+  raw_rotate(_x, _y, sine(-_yaw), cosine(-_yaw));
+  // The hip and the sole links stay vertical, the ankle and the thigh roll
+  // links stay in the leaning plane.
+  _z += raw_length(PART_HIP_Z_ROT) + raw_length(PART_ANKLE_X_ROT);
+  int16_t _roll = arctan(-_x, -_z);
+  int32_t _down = raw_sqrt(uint32_t(_x * _x) + uint32_t(_z * _z)) -
+                  raw_length(PART_HIP_X_ROT) - raw_length(PART_ANKLE_Y_ROT);
+  int32_t _thigh = raw_length(PART_HIP_Y_ROT);
+  int32_t _shin = raw_length(PART_KNEE_X_ROT);
+  int32_t _span = 2 * _thigh * _shin;
+  int32_t _fold = _y * _y + _down * _down - _thigh * _thigh - _shin * _shin;
+  if(_fold > _span || _fold < -_span) {
+    _fold = _fold > 0 ? _span : -_span;
+    _reached = false;
+  }
+  // Cosine and sine of the knee in Q2.14, the knee only bends backward.
+  int32_t _cos = (_fold << 8) / ((_span + 63) >> 6);
+  int32_t _sin = raw_sqrt(uint32_t(KIN_ONE) * KIN_ONE - _cos * _cos);
+  int16_t _knee = -arctan(_sin, _cos);
+  int16_t _pitch = arctan(_y, _down) +
+                   arctan(_shin * _sin, _thigh * KIN_ONE + _shin * _cos);
+  _angles[PART_ANKLE_X_ROT] = raw_jointPos(PART_ANKLE_X_ROT, -_roll, _reached);
+  _angles[PART_ANKLE_Y_ROT] = raw_jointPos(PART_ANKLE_Y_ROT, -_pitch - _knee,
+                                           _reached);
+  _angles[PART_KNEE_X_ROT] = raw_jointPos(PART_KNEE_X_ROT, _knee, _reached);
+  _angles[PART_HIP_Y_ROT] = raw_jointPos(PART_HIP_Y_ROT, _pitch, _reached);
+  _angles[PART_HIP_X_ROT] = raw_jointPos(PART_HIP_X_ROT, _roll, _reached);
+  _angles[PART_HIP_Z_ROT] = raw_jointPos(PART_HIP_Z_ROT, _yaw, _reached);
+  return _reached;
+}
+
+/**
+ * Prints the positions computed by the last update, one per line, as
+ * <F|H><R|L> <x> <y> <z> for the feet and the hands and C <x> <y> <z> for
+ * the COM, in mm*10.
+ */
+void BodyKinematics::printPosition() {
+  raw_printPoint('F', 'R', foot[HF_R]);
+  raw_printPoint('F', 'L', foot[HF_L]);
+  raw_printPoint('H', 'R', hand[HF_R]);
+  raw_printPoint('H', 'L', hand[HF_L]);
+  raw_printPoint('C', 0, com);
+}
+
+/**
+ * Prints how long the updates took, as K <updates> <average us> <max us>.
+ * Nothing is printed unless SERIAL_SERVO_TIMING is enabled.
+ */
+void BodyKinematics::printTiming() {
+#if SERIAL_SERVO_TIMING
+  Serial.print('K');
+  Serial.print(' ');
+  Serial.print(timing.updates);
+  Serial.print(' ');
+  Serial.print(timing.updates ? ticksToUs(timing.sumTicks / timing.updates) : 0);
+  Serial.print(' ');
+  Serial.print(ticksToUs(timing.maxTicks));
+  Serial.println();
+#endif
+}
+
+/**
+ * Clears the update time statistics.
+ */
+void BodyKinematics::clearTiming() {
+#if SERIAL_SERVO_TIMING
+  timing.updates = 0;
+  timing.sumTicks = 0;
+  timing.maxTicks = 0;
+#endif
+}
+
+/**
+ * Walks a limb from its end up to the trunk. The limb is computed as a right
+ * one and mirrored on X if it is a left one.
+ *
+ * @param _half right or left body part.
+ * @param _first index of the bodypart at the end of the limb.
+ * @param _last index of the bodypart attached to the trunk.
+ * @param _root_x mm from the middle to the limb.
+ * @param _root_z mm from the hips to the limb.
+ * @param _end position of the end of the limb, updated.
+ * @param _body mass moment and mass of the body, updated.
+ */
+inline void BodyKinematics::raw_limb(const bool &_half, const uint8_t &_first,
+                                     const uint8_t &_last,
+                                     const int16_t &_root_x,
+                                     const int16_t &_root_z, kin_point_t &_end,
+                                     kin_chain_t &_body) {
+  kin_chain_t _chain = {0, 0, 0, 0, 0, 0, 0};
+  int8_t _step = _first < _last ? 1 : -1;
+  for(uint8_t _idx = _first; ; _idx += _step) {
+    raw_link(_chain, _idx);
+    raw_joint(_chain, _half, _idx);
+    if(_idx == _last) {
+      break;
+    }
+  }
+  _chain.x -= int32_t(_root_x) * 10;
+  _chain.z += int32_t(_root_z) * 10;
+  _chain.mx -= int32_t(_chain.mass) * _root_x;
+  _chain.mz += int32_t(_chain.mass) * _root_z;
+  if(_half) {
+    _chain.x = -_chain.x;
+    _chain.mx = -_chain.mx;
+  }
+  _end.x = _chain.x;
+  _end.y = _chain.y;
+  _end.z = _chain.z;
+  _body.mx += _chain.mx;
+  _body.my += _chain.my;
+  _body.mz += _chain.mz;
+  _body.mass += _chain.mass;
+}
+
+/**
+ * Moves a chain up along the link of a bodypart, that hangs straight down
+ * from its joint, and adds the mass of the link.
+ *
+ * @param _chain chain to update.
+ * @param _idx body part index.
+ */
+inline void BodyKinematics::raw_link(kin_chain_t &_chain, const uint8_t &_idx) {
+  int16_t _length = int8_t(pgm_read_byte_near(&(joint[_idx][KIN_LENGTH])));
+  uint8_t _mass = pgm_read_byte_near(&(joint[_idx][KIN_MASS]));
+  _chain.z -= int32_t(_length) * 10;
+  _chain.mz -= (int32_t(_chain.mass) * 2 + _mass) * _length / 2;
+  _chain.mass += _mass;
+}
+
+/**
+ * Rotates a chain around the joint of a bodypart by the angle of the
+ * bodypart from its default position, offset included.
+ *
+ * @param _chain chain to update.
+ * @param _half right or left body part.
+ * @param _idx body part index.
+ */
+inline void BodyKinematics::raw_joint(kin_chain_t &_chain, const bool &_half,
+                                      const uint8_t &_idx) {
+  int16_t _angle = BodyMovement::getPos(_half, _idx) -
+                   BodyMovement::getDefaultPos(_idx) -
+                   BodyMovement::getOffset(_half, _idx);
+  if(int8_t(pgm_read_byte_near(&(joint[_idx][KIN_SIGN]))) < 0) {
+    _angle = -_angle;
+  }
+  if(!_angle) {
+    return;
+  }
+  int16_t _sin = sine(_angle);
+  int16_t _cos = cosine(_angle);
+  switch(pgm_read_byte_near(&(joint[_idx][KIN_AXIS]))) {
+    case KIN_PITCH:
+      raw_rotate(_chain.y, _chain.z, _sin, _cos);
+      raw_rotate(_chain.my, _chain.mz, _sin, _cos);
+      return;
+    case KIN_ROLL:
+      raw_rotate(_chain.z, _chain.x, _sin, _cos);
+      raw_rotate(_chain.mz, _chain.mx, _sin, _cos);
+      return;
+    case KIN_YAW:
+      raw_rotate(_chain.x, _chain.y, _sin, _cos);
+      raw_rotate(_chain.mx, _chain.my, _sin, _cos);
+      return;
+  }
+}
+
+/**
+ * Rotates the (a, b) components of a vector, b being 90 degrees ahead of a.
+ *
+ * @param _a first component, updated.
+ * @param _b second component, updated.
+ * @param _sin sine of the angle in Q2.14.
+ * @param _cos cosine of the angle in Q2.14.
+ */
+inline void BodyKinematics::raw_rotate(int32_t &_a, int32_t &_b,
+                                       const int16_t &_sin,
+                                       const int16_t &_cos) {
+  int32_t _ra = (_a * _cos - _b * _sin) >> KIN_FRACT_BITS;
+  _b = (_a * _sin + _b * _cos) >> KIN_FRACT_BITS;
+  _a = _ra;
+}
+
+/**
+ * Gets the length of the link of a bodypart.
+ *
+ * @param _idx body part index.
+ * @return length in mm*10.
+ */
+inline int16_t BodyKinematics::raw_length(const uint8_t &_idx) {
+  return int16_t(int8_t(pgm_read_byte_near(&(joint[_idx][KIN_LENGTH])))) * 10;
+}
+
+/**
+ * Converts the angle of a joint to the angle of its bodypart, within the
+ * limits of the bodypart.
+ *
+ * @param _idx body part index.
+ * @param _angle angle*10 of the joint from the default position.
+ * @param _reached cleared if the angle is out of the limits.
+ * @return angle*10 of the bodypart, as taken by setPos.
+ */
+inline uint16_t BodyKinematics::raw_jointPos(const uint8_t &_idx,
+                                             int16_t _angle, bool &_reached) {
+  if(int8_t(pgm_read_byte_near(&(joint[_idx][KIN_SIGN]))) < 0) {
+    _angle = -_angle;
+  }
+  int16_t _pos = BodyMovement::getDefaultPos(_idx) + _angle;
+  int16_t _min = BodyMovement::getMinPos(_idx);
+  int16_t _max = BodyMovement::getMaxPos(_idx);
+  if(_pos < _min) {
+    _reached = false;
+    return _min;
+  }
+  if(_pos > _max) {
+    _reached = false;
+    return _max;
+  }
+  return _pos;
+}
+
+/**
+ * Computes the integer square root of a number, a bit at a time.
+ *
+ * @param _value number.
+ * @return square root, rounded down.
+ */
+inline uint16_t BodyKinematics::raw_sqrt(uint32_t _value) {
+  uint32_t _root = 0;
+  uint32_t _bit = 1UL << 30;
+  while(_bit > _value) {
+    _bit >>= 2;
+  }
+  while(_bit) {
+    if(_value >= _root + _bit) {
+      _value -= _root + _bit;
+      _root = (_root >> 1) + _bit;
+    }
+    else {
+      _root >>= 1;
+    }
+    _bit >>= 2;
+  }
+  return _root;
+}
+
+/**
+ * See printPosition.
+ *
+ * @param _name position name.
+ * @param _half half name, 0 for none.
+ * @param _point position to print.
+ */
+inline void BodyKinematics::raw_printPoint(const char &_name,
+                                           const char &_half,
+                                           const kin_point_t &_point) {
+  Serial.print(_name);
+  if(_half) {
+    Serial.print(_half);
+  }
+  Serial.print(' ');
+  Serial.print(_point.x);
+  Serial.print(' ');
+  Serial.print(_point.y);
+  Serial.print(' ');
+  Serial.print(_point.z);
+  Serial.println();
+}
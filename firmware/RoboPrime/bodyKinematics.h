@@ -0,0 +1,175 @@
+/**
+ * Part of RoboPrime Firmware.
+ *
+ * BodyKinematics.h
+ * Robot forward and inverse kinematics.
+ *
+ * RoboPrime Firmware, (https://github.com/simonepri/RoboPrime)
+ * Copyright (c) 2015, Simone Primarosa, (https://simoneprimarosa.com)
+ *
+ * Licensed under The MIT License
+ * Redistribution of file must retain the above copyright notice.
+ *
+ * @copyright     Copyright (c) 2015, Simone Primarosa, (https://simoneprimarosa.com)
+ * @link          (https://github.com/simonepri/RoboPrime)
+ * @since         0.0.0
+ * @require       SerialServo, BodyMovement
+ * @license       MIT License (https://opensource.org/licenses/MIT)
+ */
+
+/*
+ * PURPOSE:
+ *
+ * This create a class that computes where the feet and the hands are and where
+ * the center of mass (COM) of the whole body is, from the actual angle of the
+ * bodyparts. It runs once per servo frame (50Hz).
+ * Positions are in mm*10 from the middle point between the hips, with X
+ * pointing to the left, Y forward and Z up. Each bodypart is a joint turning
+ * around one axis followed by a link that hangs straight down when the
+ * bodypart is in its default position, see KIN_JOINTS.
+ * Each limb is walked from the end up to the trunk: at each joint the end
+ * position and the mass moment of the links already walked are rotated
+ * together, so the COM costs only one more rotation per joint.
+ * All the math is fixed point: sines come from a table of whole degrees in
+ * FLASH memory, linearly interpolated, and rotations are 16x32 bit
+ * multiplications. An update is 40 interpolated sines, 40 rotations of two
+ * vectors and 3 divisions, counted as about 22000 cycles (1.4ms at 16MHz, 7%
+ * of a frame), see printTiming to measure it on the robot.
+ * solveLeg does the way back for a leg: from a position of the foot relative
+ * to its hip it gives the angles of the six bodyparts, keeping the sole
+ * parallel to the ground. It takes 4 arctangents, from a table of 1/32 steps
+ * of the tangent, 2 integer square roots and 2 divisions, about 5500 cycles
+ * (0.35ms), so both legs can be solved on every frame.
+ * NOTE: that lengths and masses are taken from the 3D models and from the
+ * MG90S datasheet, they are not measured on the assembled robot.
+ */
+
+#ifndef _BODY_KINEMATICS_H
+#define _BODY_KINEMATICS_H
+
+#define KIN_PERIOD_MS          20     // One update per servo frame.
+
+// Sines are Q2.14 numbers.
+#define KIN_FRACT_BITS         14
+#define KIN_ONE             16384
+#define KIN_SIN_SIZE           91     // sin(0..90) degrees.
+#define KIN_SIN_DIV10        6554     // Q0.16 reciprocal of 10.
+
+#define KIN_SIN_TABLE {                                                        \
+      0,   286,   572,   857,  1143,  1428,  1713,  1997,  2280,  2563,        \
+   2845,  3126,  3406,  3686,  3964,  4240,  4516,  4790,  5063,  5334,        \
+   5604,  5872,  6138,  6402,  6664,  6924,  7182,  7438,  7692,  7943,        \
+   8192,  8438,  8682,  8923,  9162,  9397,  9630,  9860, 10087, 10311,        \
+  10531, 10749, 10963, 11174, 11381, 11585, 11786, 11982, 12176, 12365,        \
+  12551, 12733, 12911, 13085, 13255, 13421, 13583, 13741, 13894, 14044,        \
+  14189, 14330, 14466, 14598, 14726, 14849, 14968, 15082, 15191, 15296,        \
+  15396, 15491, 15582, 15668, 15749, 15826, 15897, 15964, 16026, 16083,        \
+  16135, 16182, 16225, 16262, 16294, 16322, 16344, 16362, 16374, 16382,        \
+  16384                                                                        \
+}
+
+// Arctangents are angle*10 of the tangents from 0 to 1 in steps of 1/32.
+#define KIN_ATAN_SIZE          33
+#define KIN_ATAN_SHIFT         11     // From a Q0.16 tangent to a table index.
+
+#define KIN_ATAN_TABLE {                                                       \
+    0,  18,  36,  54,  71,  89, 106, 123, 140, 157, 174, 190, 206, 221, 236,   \
+  251, 266, 280, 294, 307, 320, 333, 345, 357, 369, 380, 391, 402, 412, 422,   \
+  432, 441, 450                                                                \
+}
+
+#define KIN_PITCH               0     // Around X.
+#define KIN_ROLL                1     // Around Y.
+#define KIN_YAW                 2     // Around Z.
+
+#define KIN_AXIS                0
+#define KIN_SIGN                1
+#define KIN_LENGTH              2     // mm from the joint to the next one.
+#define KIN_MASS                3     // g, centered on the link.
+#define KIN_SIZE                4
+
+// Joints of the right half, the left half is mirrored on X. Legs go from the
+// sole up to the hip, arms from the hand up to the shoulder.
+#define KIN_JOINTS {                                                           \
+  {KIN_ROLL,   1, 25, 30}, {KIN_PITCH,  1, 15, 17},                            \
+  {KIN_PITCH,  1, 52, 20}, {KIN_PITCH, -1, 52, 30},                            \
+  {KIN_ROLL,   1, 15, 17}, {KIN_YAW,    1, 15, 17},                            \
+  {KIN_PITCH, -1, 15, 17}, {KIN_ROLL,   1, 45, 20},                            \
+  {KIN_YAW,    1, 25, 17}, {KIN_PITCH,  1, 50, 12}                             \
+}
+
+#define KIN_HIP_X              30     // mm from the middle to each hip.
+#define KIN_SHOULDER_X         45     // mm from the middle to each shoulder.
+#define KIN_SHOULDER_Z         75     // mm from the hips to the shoulders.
+#define KIN_TRUNK_Z            40     // mm from the hips to the trunk center.
+#define KIN_TRUNK_MASS         60     // g, board, regulators and frame.
+
+struct kin_point_t {
+  int16_t x, y, z;
+};
+
+struct kin_chain_t {
+  int32_t x, y, z;                    // End position, mm*10.
+  int32_t mx, my, mz;                 // Mass moment, g*mm.
+  uint16_t mass;
+};
+
+struct kin_timing_t {
+  uint16_t updates;
+  uint32_t sumTicks, maxTicks;
+};
+
+typedef const PROGMEM int8_t kin_joint_t;
+typedef const PROGMEM int16_t kin_sin_t;
+typedef const PROGMEM uint16_t kin_atan_t;
+
+class BodyKinematics {
+  public:
+    static void begin();
+    static void kinematicsRoutine();
+    static void update();
+    static kin_point_t getFoot(bool _half);
+    static kin_point_t getHand(bool _half);
+    static kin_point_t getCom();
+    static int8_t getSign(uint8_t _idx);
+    static int16_t sine(int16_t _angle);
+    static int16_t cosine(int16_t _angle);
+    static int16_t arctan(int32_t _y, int32_t _x);
+    static bool solveLeg(bool _half, kin_point_t _foot, int16_t _yaw,
+                         uint16_t *_angles);
+    static void printPosition();
+    static void printTiming();
+    static void clearTiming();
+  private:
+    // No-one have to create an istance of this class as we use it as
+    // a singleton, so we keep constructor as private.
+    BodyKinematics();
+
+    static void raw_limb(const bool &_half, const uint8_t &_first,
+                         const uint8_t &_last, const int16_t &_root_x,
+                         const int16_t &_root_z, kin_point_t &_end,
+                         kin_chain_t &_body);
+    static void raw_link(kin_chain_t &_chain, const uint8_t &_idx);
+    static void raw_joint(kin_chain_t &_chain, const bool &_half,
+                          const uint8_t &_idx);
+    static void raw_rotate(int32_t &_a, int32_t &_b, const int16_t &_sin,
+                           const int16_t &_cos);
+    static int16_t raw_length(const uint8_t &_idx);
+    static uint16_t raw_jointPos(const uint8_t &_idx, int16_t _angle,
+                                 bool &_reached);
+    static uint16_t raw_sqrt(uint32_t _value);
+    static void raw_printPoint(const char &_name, const char &_half,
+                               const kin_point_t &_point);
+
+    static kin_joint_t joint[HF_NUM][KIN_SIZE];
+    static kin_sin_t sinTable[KIN_SIN_SIZE];
+    static kin_atan_t atanTable[KIN_ATAN_SIZE];
+    static kin_point_t foot[HF_SIZE], hand[HF_SIZE];
+    static kin_point_t com;
+    static uint32_t lastUpdate;
+#if SERIAL_SERVO_TIMING
+    static kin_timing_t timing;
+#endif
+};
+
+#endif
@@ -39,20 +39,78 @@ body_offset_t
   BodyMovement::offset[HF_NUM][HF_SIZE] = SERVO_ANGLE_OFFSET;
 
 /**
- * head and tail array is located in SRAM momery and store respectivley
- * information about the index of next free queue block and the index of the
- * last unfree block.
+ * speed array is located in FLASH momery and store information about the top
+ * speed of each bodypart.
+ */
+body_speed_t
+  BodyMovement::speed[HF_NUM] = SERVO_SPEED_MAX;
+
+/**
+ * first and last array is located in SRAM momery and store respectivley
+ * information about the pool index of the next planned movement and of the
+ * last planned movement of each bodypart.
+ */
+uint8_t
+  BodyMovement::first[HF_SIZE][HF_NUM],
+  BodyMovement::last[HF_SIZE][HF_NUM];
+
+/**
+ * freeBlock is located in SRAM momery and store the pool index of the first
+ * unused block.
+ */
+uint8_t
+  BodyMovement::freeBlock;
+
+/**
+ * freeBlocks and creditBlocks are located in SRAM momery and store how many
+ * blocks are unused and how many of them are granted to the host.
  */
 uint8_t
-  BodyMovement::head[HF_SIZE][HF_NUM],
-  BodyMovement::tail[HF_SIZE][HF_NUM];
+  BodyMovement::freeBlocks,
+  BodyMovement::creditBlocks;
 
 /**
- * queue array is located in SRAM momery and store information about the next
- * planned movment for each bodypart.
+ * pool array is located in SRAM momery and store information about the
+ * planned movments of all the bodyparts.
  */
 block_t
-  BodyMovement::queue[HF_SIZE][HF_NUM][BF_SIZE];
+  BodyMovement::pool[POOL_SIZE];
+
+/**
+ * pendingMask is located in SRAM momery and store a bit for each bodypart with
+ * planned movements, the bit index being the servo channel of the bodypart.
+ */
+uint32_t
+  BodyMovement::pendingMask;
+
+/**
+ * keyClockTicks and keyClockMs are located in SRAM momery and store the
+ * keyframe clock, that is the last whole millisecond from the epoch and the
+ * SerialServo clock value at which it began.
+ */
+uint32_t
+  BodyMovement::keyClockTicks;
+uint16_t
+  BodyMovement::keyClockMs;
+
+#if SERIAL_SERVO_TIMING
+/**
+ * delayMask and timing are located in SRAM momery and store respectivley the
+ * bodyparts whose next movement has to start on the deadline of the previous
+ * one and how much the planner delayed those starts.
+ */
+uint32_t
+  BodyMovement::delayMask;
+planner_timing_t
+  BodyMovement::timing;
+#endif
+
+/**
+ * junction array is located in SRAM momery and store the entry speed planned
+ * for the next queued movement of each bodypart, see SerialServo blendSweep.
+ */
+uint8_t
+  BodyMovement::junction[HF_SIZE][HF_NUM];
 
 /**
  * Initializes class's fields.
@@ -61,8 +119,20 @@ void BodyMovement::begin() {
   setDefault();
   
   for(uint8_t _idx = 0; _idx < HF_NUM; _idx++) {
-    head[HF_R][_idx] = head[HF_L][_idx] = 0;
+    first[HF_R][_idx] = first[HF_L][_idx] = BLOCK_NONE;
+    last[HF_R][_idx] = last[HF_L][_idx] = BLOCK_NONE;
+    junction[HF_R][_idx] = junction[HF_L][_idx] = JUNCTION_STOP;
   }
+  for(uint8_t _block = 0; _block < POOL_SIZE; _block++) {
+    pool[_block].next = _block + 1;
+  }
+  pool[POOL_SIZE - 1].next = BLOCK_NONE;
+  freeBlock = 0;
+  freeBlocks = POOL_SIZE;
+  creditBlocks = 0;
+  pendingMask = 0;
+  setEpoch();
+  clearTiming();
 }
 
 /**
@@ -87,6 +157,7 @@ void BodyMovement::setPos(bool _half, uint8_t _idx, uint16_t _angle) {
   if(!isValidBodypart(_idx)) {
     return;
   }
+  junction[_half][_idx] = JUNCTION_STOP;
   raw_setPos(_half, _idx, _angle);
 }
 
@@ -98,14 +169,91 @@ void BodyMovement::setPos(bool _half, uint8_t _idx, uint16_t _angle) {
  * @param _angle angle*10 to set.
  * @param _time duration of
  * movment.
+ * @param _profile velocity profile, see SerialServo SWEEP_*.
  */
 void BodyMovement::setSweep(bool _half, uint8_t _idx, uint16_t _angle,
-                            uint16_t _time) {
+                            uint16_t _time, uint8_t _profile) {
   if(!isValidBodypart(_idx)) {
     return;
   }
   _angle = raw_validAngle(_half, _idx, _angle);
-  raw_setSweep(_half, _idx, _angle, _time);
+  junction[_half][_idx] = JUNCTION_STOP;
+  raw_setSweep(_half, _idx, _angle, _time, _profile);
+}
+
+/**
+ * Applies a pose to all the bodyparts at once.
+ * Without a duration the whole pose is written on the same SerialServo frame,
+ * otherwise every bodypart sweeps to it with a linear setMove.
+ *
+ * @param _angles angle*10 of each bodypart, right ones first, or
+ * INVALID_BODY_POS to leave a bodypart as it is.
+ * @param _time duration of the movment, 0 to write the pose.
+ */
+void BodyMovement::setPose(const uint16_t *_angles, uint16_t _time) {
+  if(_time) {
+    setMove(_angles, _time, SWEEP_LINEAR);
+    return;
+  }
+  for(uint8_t _half = HF_R; _half < HF_SIZE; _half++) {
+    for(uint8_t _idx = 0; _idx < HF_NUM; _idx++, _angles++) {
+      if(*_angles == INVALID_BODY_POS) {
+        continue;
+      }
+      junction[_half][_idx] = JUNCTION_STOP;
+      raw_stagePos(_half, _idx, raw_validAngle(_half, _idx, *_angles));
+    }
+  }
+  SerialServo::commitFrame();
+}
+
+/**
+ * Moves a group of bodyparts as a single unit: all of them start on the same
+ * SerialServo frame and reach their angle on the same deadline.
+ * The duration is stretched if any bodypart would have to go faster than its
+ * top speed, so a duration of 0 moves the group as fast as its slowest
+ * bodypart allows.
+ *
+ * @param _angles angle*10 of each bodypart, right ones first, or
+ * INVALID_BODY_POS to leave a bodypart out of the group.
+ * @param _time minimum duration of the movment.
+ * @param _profile velocity profile, see SWEEP_*.
+ */
+void BodyMovement::setMove(const uint16_t *_angles, uint16_t _time,
+                           uint8_t _profile) {
+  if(_profile >= SWEEP_SIZE) {
+    _profile = SWEEP_LINEAR;
+  }
+  uint32_t _slowest = _time;
+  const uint16_t *_angle = _angles;
+  for(uint8_t _half = HF_R; _half < HF_SIZE; _half++) {
+    for(uint8_t _idx = 0; _idx < HF_NUM; _idx++, _angle++) {
+      if(*_angle == INVALID_BODY_POS) {
+        continue;
+      }
+      uint16_t _from = raw_getPos(_half, _idx);
+      uint16_t _to = raw_validAngle(_half, _idx, *_angle);
+      uint32_t _limit = raw_moveTime(_idx, _to > _from ? _to - _from :
+                                                        _from - _to, _profile);
+      if(_limit > _slowest) {
+        _slowest = _limit;
+      }
+    }
+  }
+  if(_slowest > 0xFFFF) {
+    _slowest = 0xFFFF;
+  }
+  for(uint8_t _half = HF_R; _half < HF_SIZE; _half++) {
+    for(uint8_t _idx = 0; _idx < HF_NUM; _idx++, _angles++) {
+      if(*_angles == INVALID_BODY_POS) {
+        continue;
+      }
+      junction[_half][_idx] = JUNCTION_STOP;
+      raw_stageSweep(_half, _idx, raw_validAngle(_half, _idx, *_angles),
+                     _slowest, _profile);
+    }
+  }
+  SerialServo::commitFrame();
 }
 
 /**
@@ -161,9 +309,29 @@ void BodyMovement::setWait(bool _half, uint8_t _idx, uint16_t _time) {
   if(!isValidBodypart(_idx)) {
     return;
   }
+  junction[_half][_idx] = JUNCTION_STOP;
   raw_setWait(_half, _idx, _time);
 }
 
+/**
+ * Corrects a bodypart by an angle on top of its position and of its
+ * movements, until it is corrected again, see SerialServo::trimAngle.
+ *
+ * @param _half right or left body part.
+ * @param _idx body part index.
+ * @param _angle angle*10 to add, 0 to remove the correction.
+ */
+void BodyMovement::setTrim(bool _half, uint8_t _idx, int16_t _angle) {
+  if(!isValidBodypart(_idx)) {
+    return;
+  }
+  if(_half) {
+    SerialServo::trimAngle(HF_NUM + _idx, _angle, _half);
+    return;
+  }
+  SerialServo::trimAngle(_idx, _angle);
+}
+
 /**
  * Gets the actual position of a bodypart.
  *
@@ -204,6 +372,20 @@ uint16_t BodyMovement::getDefaultPos(uint8_t _idx) {
   return raw_getDefaultPos(_idx);
 }
 
+/**
+ * Gets the angle offset of a bodypart, that is added to every angle set.
+ *
+ * @param _half right or left body part.
+ * @param _idx body part index.
+ * @return angle*10 offset.
+ */
+int8_t BodyMovement::getOffset(bool _half, uint8_t _idx) {
+  if(!isValidBodypart(_idx)) {
+    return 0;
+  }
+  return raw_getOffset(_half, _idx);
+}
+
 /**
  * Gets the maximum position for a bodypart.
  *
@@ -217,6 +399,19 @@ uint16_t BodyMovement::getMaxPos(uint8_t _idx) {
   return raw_getMaxPos(_idx);
 }
 
+/**
+ * Gets the top speed of a bodypart.
+ *
+ * @param _idx body part index.
+ * @return angle*10 per second.
+ */
+uint16_t BodyMovement::getMaxSpeed(uint8_t _idx) {
+  if(!isValidBodypart(_idx)) {
+    return 0;
+  }
+  return raw_getMaxSpeed(_idx);
+}
+
 /**
  * Checks if a bodypart is moving
  *
@@ -236,19 +431,83 @@ bool BodyMovement::isMoving(bool _half, uint8_t _idx) {
  * @param _half right or left body part.
  * @param _idx body part index.
  * @param _angle angle*10 to set.
- * @param _time duration of the movment.
+ * @param _time duration of the movment.
+ * @param _profile velocity profile, see SerialServo SWEEP_*.
  * 
  * @return false if the queue is full or the bodypart is invalid.
  */
 bool BodyMovement::pushQueue(bool _half, uint8_t _idx, uint16_t _angle,
-                             uint16_t _time) {
+                             uint16_t _time, uint8_t _profile) {
+  if(!isValidBodypart(_idx) || raw_isQueueFull(_half, _idx)) {
+    return false;
+  }
+  if(_profile >= SWEEP_SIZE) {
+    _profile = SWEEP_LINEAR;
+  }
+  raw_pushQueue(_half, _idx, _angle, _time, _profile, 0);
+  return true;
+}
+
+/**
+ * Inserts a keyframe into the queue, that is a movement that starts at a given
+ * time from the epoch, see setEpoch. It still waits for the previous movements
+ * of the bodypart to end, the time between them is kept still.
+ *
+ * @param _half right or left body part.
+ * @param _idx body part index.
+ * @param _angle angle*10 to set.
+ * @param _time duration of the movment.
+ * @param _start start of the movement, in ms from the epoch.
+ * @param _profile velocity profile, see SerialServo SWEEP_*.
+ *
+ * @return false if the queue is full or the bodypart is invalid.
+ */
+bool BodyMovement::pushKeyframe(bool _half, uint8_t _idx, uint16_t _angle,
+                                uint16_t _time, uint16_t _start,
+                                uint8_t _profile) {
   if(!isValidBodypart(_idx) || raw_isQueueFull(_half, _idx)) {
     return false;
   }
-  raw_pushQueue(_half, _idx, _angle, _time);
+  if(_profile >= SWEEP_SIZE) {
+    _profile = SWEEP_LINEAR;
+  }
+  raw_pushQueue(_half, _idx, _angle, _time, _profile | BLOCK_KEYFRAME, _start);
   return true;
 }
 
+/**
+ * Sets the epoch of the keyframes to now.
+ */
+void BodyMovement::setEpoch() {
+  keyClockTicks = SerialServo::readClock();
+  keyClockMs = 0;
+}
+
+/**
+ * Drops the planned movements of all the bodyparts, the movements already
+ * started are not stopped. Every chain goes back to the free list, the
+ * granted blocks stay granted and the keyframe epoch is set to now.
+ */
+void BodyMovement::clearQueue() {
+  for(uint8_t _half = HF_R; _half < HF_SIZE; _half++) {
+    for(uint8_t _idx = 0; _idx < HF_NUM; _idx++) {
+      junction[_half][_idx] = JUNCTION_STOP;
+      if(first[_half][_idx] == BLOCK_NONE) {
+        continue;
+      }
+      pool[last[_half][_idx]].next = freeBlock;
+      freeBlock = first[_half][_idx];
+      first[_half][_idx] = last[_half][_idx] = BLOCK_NONE;
+    }
+  }
+  freeBlocks = POOL_SIZE;                       // The others are all chained.
+  pendingMask = 0;
+#if SERIAL_SERVO_TIMING
+  delayMask = 0;
+#endif
+  setEpoch();
+}
+
 /**
  * Executes one movement from the queue.
  *
@@ -264,8 +523,76 @@ bool BodyMovement::popQueue(bool _half, uint8_t _idx) {
   return true;
 }
 
+/**
+ * Gets how many blocks of the pool can still be granted, the reserved ones
+ * are never granted.
+ *
+ * @return unused blocks that are not granted nor reserved.
+ */
+uint8_t BodyMovement::getFreeBlocks() {
+  if(freeBlocks <= creditBlocks + POOL_RESERVE) {
+    return 0;
+  }
+  return freeBlocks - creditBlocks - POOL_RESERVE;
+}
+
+/**
+ * Gets how many granted blocks have not been used yet.
+ *
+ * @return granted blocks.
+ */
+uint8_t BodyMovement::getCredits() {
+  return creditBlocks;
+}
+
+/**
+ * Grants all the blocks that can be granted, they are kept for pushCredit and
+ * the other pushes see the queue as full without them.
+ *
+ * @return blocks granted by this call.
+ */
+uint8_t BodyMovement::grantCredits() {
+  uint8_t _granted = getFreeBlocks();
+  creditBlocks += _granted;
+  return _granted;
+}
+
+/**
+ * Takes back all the granted blocks.
+ */
+void BodyMovement::clearCredits() {
+  creditBlocks = 0;
+}
+
+/**
+ * Inserts a movement into the queue using a granted block, see pushQueue.
+ *
+ * @param _half right or left body part.
+ * @param _idx body part index.
+ * @param _angle angle*10 to set.
+ * @param _time duration of the movment.
+ * @param _profile velocity profile, see SerialServo SWEEP_*.
+ *
+ * @return false if no block is granted or the bodypart is invalid.
+ */
+bool BodyMovement::pushCredit(bool _half, uint8_t _idx, uint16_t _angle,
+                              uint16_t _time, uint8_t _profile) {
+  if(!isValidBodypart(_idx) || !creditBlocks) {
+    return false;
+  }
+  if(_profile >= SWEEP_SIZE) {
+    _profile = SWEEP_LINEAR;
+  }
+  creditBlocks--;
+  raw_pushQueue(_half, _idx, _angle, _time, _profile, 0);
+  return true;
+}
+
 /**
  * Checks if the queue is full.
+ * All the bodyparts share the same pool of blocks, so the queue is full when
+ * no block is left in the pool but the granted ones, or but the reserved ones
+ * if the bodypart already has planned movements, see POOL_RESERVE.
  *
  * @param _half right or left body part.
  * @param _idx body part index.
@@ -358,15 +685,57 @@ inline void BodyMovement::raw_setPos(const bool &_half, const uint8_t &_idx,
  * @param _idx body part index.
  * @param _angle angle*10 to set.
  * @param _time duration of the movment.
+ * @param _profile velocity profile, see SerialServo SWEEP_*.
  */
 inline void BodyMovement::raw_setSweep(const bool &_half, const uint8_t &_idx,
                                        const uint16_t &_angle,
-                                       const uint16_t &_time) {
+                                       const uint16_t &_time,
+                                       const uint8_t &_profile) {
+  if(_half) {
+    SerialServo::sweepAngle(HF_NUM + _idx, _angle, _time, _half, _profile);
+    return;
+  }
+  SerialServo::sweepAngle(_idx, _angle, _time, false, _profile);
+}
+
+/**
+ * Stages an angle for a bodypart, it is written by the next
+ * SerialServo commitFrame.
+ *
+ * @param _half right or left body part.
+ * @param _idx body part index.
+ * @param _angle angle*10 to set, already contrained.
+ */
+inline void BodyMovement::raw_stagePos(const bool &_half, const uint8_t &_idx,
+                                       const uint16_t &_angle) {
+  if(_half) {
+    SerialServo::stageAngle(HF_NUM + _idx, _angle, _half);
+    return;
+  }
+  SerialServo::stageAngle(_idx, _angle);
+}
+
+/**
+ * Stages a sweep for a bodypart, it starts with the next
+ * SerialServo commitFrame.
+ *
+ * @param _half right or left body part.
+ * @param _idx body part index.
+ * @param _angle angle*10 to reach, already contrained.
+ * @param _time time to sweep.
+ * @param _profile velocity profile, see SWEEP_*.
+ */
+inline void BodyMovement::raw_stageSweep(const bool &_half,
+                                         const uint8_t &_idx,
+                                         const uint16_t &_angle,
+                                         const uint16_t &_time,
+                                         const uint8_t &_profile) {
   if(_half) {
-    SerialServo::sweepAngle(HF_NUM + _idx, _angle, _time, _half);
+    SerialServo::stageSweepAngle(HF_NUM + _idx, _angle, _time, _half,
+                                 _profile);
     return;
   }
-  SerialServo::sweepAngle(_idx, _angle, _time);
+  SerialServo::stageSweepAngle(_idx, _angle, _time, false, _profile);
 }
 
 /**
@@ -431,6 +800,18 @@ inline uint16_t BodyMovement::raw_getDefaultPos(const uint8_t &_idx) {
   return pgm_read_word_near(&(pos[_idx][POS_MED]));
 }
 
+/**
+ * See getOffset
+ *
+ * @param _half right or left body part.
+ * @param _idx body part index.
+ * @return angle*10 offset.
+ */
+inline int8_t BodyMovement::raw_getOffset(const bool &_half,
+                                          const uint8_t &_idx) {
+  return pgm_read_byte_near(&(offset[_idx][_half]));
+}
+
 /**
  * See getMaxPos
  *
@@ -441,6 +822,39 @@ inline uint16_t BodyMovement::raw_getMaxPos(const uint8_t &_idx) {
   return pgm_read_word_near(&(pos[_idx][POS_MAX]));
 }
 
+/**
+ * See getMaxSpeed
+ *
+ * @param _idx body part index.
+ * @return angle*10 per second.
+ */
+inline uint16_t BodyMovement::raw_getMaxSpeed(const uint8_t &_idx) {
+  return pgm_read_word_near(&(speed[_idx]));
+}
+
+/**
+ * Computes the shortest time in which a bodypart can sweep for an angle
+ * without going faster than its top speed at the peak of the profile.
+ *
+ * @param _idx body part index.
+ * @param _delta angle*10 to sweep.
+ * @param _profile velocity profile, see SWEEP_*.
+ * @return time in milliseconds, rounded up.
+ */
+inline uint32_t BodyMovement::raw_moveTime(const uint8_t &_idx,
+                                           const uint16_t &_delta,
+                                           const uint8_t &_profile) {
+  uint16_t _peak = SPEED_PEAK_LINEAR;
+  if(_profile == SWEEP_TRAPEZOID) {
+    _peak = SPEED_PEAK_TRAPEZOID;
+  }
+  else if(_profile == SWEEP_SCURVE) {
+    _peak = SPEED_PEAK_SCURVE;
+  }
+  uint16_t _speed = raw_getMaxSpeed(_idx);
+  return (uint32_t(_delta) * _peak + _speed - 1) / _speed;
+}
+
 /**
  * See isMoving
  *
@@ -462,13 +876,40 @@ inline bool BodyMovement::raw_isMoving(const bool &_half, const uint8_t &_idx) {
  * @param _idx body part index.
  * @param _angle angle*10 to set.
  * @param _time duration of the movment.
+ * @param _profile velocity profile, see SerialServo SWEEP_*, plus
+ * BLOCK_KEYFRAME for keyframes.
+ * @param _start start of a keyframe, in ms from the epoch.
  */
 inline void BodyMovement::raw_pushQueue(const bool &_half, const uint8_t &_idx,
                                         const uint16_t &_angle,
-                                        const uint16_t &_time) {
-  queue[_half][_idx][head[_half][_idx]].movAngle = _angle;
-  queue[_half][_idx][head[_half][_idx]].movTime = _time;
-  head[_half][_idx] = nextQueue(head[_half][_idx]);
+                                        const uint16_t &_time,
+                                        const uint8_t &_profile,
+                                        const uint16_t &_start) {
+  uint8_t _block = freeBlock;
+  freeBlock = pool[_block].next;
+  freeBlocks--;
+  pool[_block].movAngle = _angle;
+  pool[_block].movTime = _time;
+  pool[_block].movProfile = _profile;
+  pool[_block].movStart = _start;
+  pool[_block].next = BLOCK_NONE;
+  if(last[_half][_idx] == BLOCK_NONE) {
+    first[_half][_idx] = _block;
+    uint32_t _bit = 1UL << (_half ? HF_NUM + _idx : _idx);
+    pendingMask |= _bit;
+#if SERIAL_SERVO_TIMING
+    if(raw_isMoving(_half, _idx)) {
+      delayMask |= _bit;
+    }
+    else {
+      delayMask &= ~_bit;
+    }
+#endif
+  }
+  else {
+    pool[last[_half][_idx]].next = _block;
+  }
+  last[_half][_idx] = _block;
 }
 
 /**
@@ -478,14 +919,175 @@ inline void BodyMovement::raw_pushQueue(const bool &_half, const uint8_t &_idx,
  * @param _idx body part index.
  */
 inline void BodyMovement::raw_popQueue(const bool &_half, const uint8_t &_idx) {
-  if(queue[_half][_idx][tail[_half][_idx]].movAngle == INVALID_BODY_POS) {
-    raw_setWait(_half, _idx, queue[_half][_idx][tail[_half][_idx]].movTime);
+  uint8_t _index = first[_half][_idx];
+  const block_t &_block = pool[_index];
+  first[_half][_idx] = _block.next;
+  if(_block.next == BLOCK_NONE) {
+    last[_half][_idx] = BLOCK_NONE;
+    pendingMask &= ~(1UL << (_half ? HF_NUM + _idx : _idx));
   }
+#if SERIAL_SERVO_TIMING
   else {
-    raw_setSweep(_half, _idx, queue[_half][_idx][tail[_half][_idx]].movAngle, 
-                 queue[_half][_idx][tail[_half][_idx]].movTime);
+    delayMask |= 1UL << (_half ? HF_NUM + _idx : _idx);
   }
-  tail[_half][_idx] = nextQueue(tail[_half][_idx]);
+#endif
+  uint8_t _entry = junction[_half][_idx];
+  junction[_half][_idx] = JUNCTION_STOP;
+  if(isKeyframe(_block)) {
+    // The movement is timed from its keyframe, not from the previous one.
+    SerialServo::setSequenceStart(_half ? HF_NUM + _idx : _idx,
+                                  raw_keyframeTicks(_block.movStart));
+  }
+  if(_block.movAngle == INVALID_BODY_POS) {
+    raw_setWait(_half, _idx, _block.movTime);
+  }
+  else {
+    uint8_t _exit = raw_planJunction(_half, _idx, _block);
+    raw_setSweep(_half, _idx, _block.movAngle, _block.movTime,
+                 blockProfile(_block));
+    if(_entry != JUNCTION_STOP || _exit != JUNCTION_STOP) {
+      raw_blendSweep(_half, _idx, _entry, _exit);
+    }
+  }
+  pool[_index].next = freeBlock;                // Gives the block back.
+  freeBlock = _index;
+  freeBlocks++;
+}
+
+/**
+ * Looks ahead at the movement following the one being popped. If both are
+ * profiled and go in the same direction the junction between them is passed at
+ * the slower of their average speeds, the entry speed of the next movement is
+ * saved in the junction array.
+ *
+ * @param _half right or left body part.
+ * @param _idx body part index.
+ * @param _block movement being popped, already unchained.
+ * @return exit speed of the movement being popped.
+ */
+inline uint8_t BodyMovement::raw_planJunction(const bool &_half,
+                                              const uint8_t &_idx,
+                                              const block_t &_block) {
+  if(blockProfile(_block) == SWEEP_LINEAR || _block.movTime == 0 ||
+     raw_isQueueEmpty(_half, _idx)) {
+    return JUNCTION_STOP;
+  }
+  const block_t &_next = pool[first[_half][_idx]];
+  if(_next.movAngle == INVALID_BODY_POS || blockProfile(_next) == SWEEP_LINEAR ||
+     _next.movTime == 0) {
+    return JUNCTION_STOP;
+  }
+  if(isKeyframe(_next) && (!isKeyframe(_block) ||
+     _next.movStart != uint16_t(_block.movStart + _block.movTime))) {
+    return JUNCTION_STOP;                       // Not back to back.
+  }
+  int16_t _delta = _block.movAngle - raw_getPos(_half, _idx);
+  int16_t _next_delta = _next.movAngle - _block.movAngle;
+  if(_delta == 0 || _next_delta == 0 || (_delta < 0) != (_next_delta < 0)) {
+    return JUNCTION_STOP;
+  }
+  if(_delta < 0) {
+    _delta = -_delta;
+    _next_delta = -_next_delta;
+  }
+  junction[_half][_idx] = raw_junctionSpeed(_delta, _block.movTime,
+                                            _next_delta, _next.movTime);
+  return raw_junctionSpeed(_next_delta, _next.movTime, _delta, _block.movTime);
+}
+
+/**
+ * Computes the speed of a junction as a fraction of the average speed of
+ * movement b, the junction speed being the slower of the two average speeds.
+ *
+ * @param _delta_a angle*10 covered by movement a.
+ * @param _time_a duration of movement a, not 0.
+ * @param _delta_b angle*10 covered by movement b, not 0.
+ * @param _time_b duration of movement b.
+ * @return junction speed, see SerialServo JUNCTION_FULL.
+ */
+inline uint8_t BodyMovement::raw_junctionSpeed(const uint16_t &_delta_a,
+                                               const uint16_t &_time_a,
+                                               const uint16_t &_delta_b,
+                                               const uint16_t &_time_b) {
+  uint32_t _num = uint32_t(_delta_a) * _time_b;
+  uint32_t _den = uint32_t(_delta_b) * _time_a;
+  if(_num >= _den) {
+    return JUNCTION_FULL;
+  }
+  while(_den > 0xFFFFFFUL) {                    // Keeps _num * 255 in 32 bit.
+    _num >>= 1;
+    _den >>= 1;
+  }
+  return (_num * JUNCTION_FULL) / _den;
+}
+
+/**
+ * Advances the keyframe clock up to now. While movements are planned it is
+ * called every loop and moves by a single millisecond, otherwise the whole
+ * idle time is added with one division.
+ *
+ * @param _now clock ticks.
+ */
+inline void BodyMovement::raw_keyClock(const uint32_t &_now) {
+  uint32_t _elapsed = _now - keyClockTicks;
+  if(_elapsed < msToTicks(1)) {
+    return;
+  }
+  uint32_t _ms = 1;
+  if(_elapsed >= msToTicks(2)) {
+    _ms = _elapsed / msToTicks(1);
+  }
+  keyClockTicks += _ms * msToTicks(1);
+  keyClockMs += _ms;                            // Modulo 2^16.
+}
+
+/**
+ * Converts a keyframe time to a clock value.
+ *
+ * @param _start time in ms from the epoch, at most ~32 seconds from now.
+ * @return clock ticks.
+ */
+inline uint32_t BodyMovement::raw_keyframeTicks(const uint16_t &_start) {
+  return keyClockTicks + int32_t(int16_t(_start - keyClockMs)) * msToTicks(1);
+}
+
+/**
+ * Computes when the next movement of a bodypart with planned movements can
+ * start, that is the end of the current movement or the keyframe time if
+ * later.
+ *
+ * @param _ch servo channel of the bodypart.
+ * @return clock ticks.
+ */
+inline uint32_t BodyMovement::raw_readyTime(const uint8_t &_ch) {
+  uint32_t _ready = SerialServo::readDeadline(_ch);
+  bool _half = _ch >= HF_NUM;
+  const block_t &_block = pool[first[_half][_half ? _ch - HF_NUM : _ch]];
+  if(isKeyframe(_block)) {
+    uint32_t _start = raw_keyframeTicks(_block.movStart);
+    if(int32_t(_start - _ready) > 0) {
+      _ready = _start;
+    }
+  }
+  return _ready;
+}
+
+/**
+ * See SerialServo blendSweep.
+ *
+ * @param _half right or left body part.
+ * @param _idx body part index.
+ * @param _entry speed at the start of the movement.
+ * @param _exit speed at the end of the movement.
+ */
+inline void BodyMovement::raw_blendSweep(const bool &_half, const uint8_t &_idx,
+                                         const uint8_t &_entry,
+                                         const uint8_t &_exit) {
+  if(_half) {
+    SerialServo::blendSweep(HF_NUM + _idx, _entry, _exit);
+    return;
+  }
+  SerialServo::blendSweep(_idx, _entry, _exit);
 }
 
 /**
@@ -497,7 +1099,10 @@ inline void BodyMovement::raw_popQueue(const bool &_half, const uint8_t &_idx) {
  */
 inline bool BodyMovement::raw_isQueueFull(const bool &_half,
                                           const uint8_t &_idx) {
-  return fullQueue(nextQueue(head[_half][_idx]), tail[_half][_idx]);
+  if(first[_half][_idx] == BLOCK_NONE) {
+    return freeBlocks <= creditBlocks;
+  }
+  return freeBlocks <= creditBlocks + POOL_RESERVE;
 }
 
 /**
@@ -509,23 +1114,86 @@ inline bool BodyMovement::raw_isQueueFull(const bool &_half,
  */
 inline bool BodyMovement::raw_isQueueEmpty(const bool &_half,
                                            const uint8_t &_idx) {
-  return emptyQueue(head[_half][_idx], tail[_half][_idx]);
+  return first[_half][_idx] == BLOCK_NONE;
 }
 
 /**
  * This routine is called by the loop and flush the movement queue.
+ * The clock is read once, then every bodypart with planned movements that can
+ * start is popped, the earliest first, see raw_readyTime.
  */
 void BodyMovement::movementPlanner() {
-  static uint8_t _idx = 0;
-  bool _half = false;
-  do {
-    if(!isMoving(_half, _idx) && !raw_isQueueEmpty(_half, _idx)) {
-      raw_popQueue(_half, _idx);
+  if(!pendingMask) {
+    return;
+  }
+  uint32_t _now = SerialServo::readClock();
+  raw_keyClock(_now);
+  uint32_t _ready = 0;
+  uint32_t _bit = 1;
+  for(uint8_t _ch = 0; _ch < HF_SIZE * HF_NUM; _ch++, _bit <<= 1) {
+    if((pendingMask & _bit) && int32_t(raw_readyTime(_ch) - _now) <= 0) {
+      _ready |= _bit;
     }
-    _half = !_half;
   }
-  while(_half);
-  if(++_idx >= HF_NUM) {
-    _idx = 0;
+  while(_ready) {
+    bool _found = false;
+    uint8_t _first = 0;
+    uint32_t _first_deadline = 0;
+    _bit = 1;
+    for(uint8_t _ch = 0; _ch < HF_SIZE * HF_NUM; _ch++, _bit <<= 1) {
+      if(!(_ready & _bit)) {
+        continue;
+      }
+      uint32_t _deadline = raw_readyTime(_ch);
+      if(!_found || int32_t(_deadline - _first_deadline) < 0) {
+        _found = true;
+        _first = _ch;
+        _first_deadline = _deadline;
+      }
+    }
+    _ready &= ~(1UL << _first);
+    bool _half = _first >= HF_NUM;
+    uint8_t _idx = _half ? _first - HF_NUM : _first;
+#if SERIAL_SERVO_TIMING
+    if((delayMask & (1UL << _first)) || isKeyframe(pool[first[_half][_idx]])) {
+      uint32_t _delay = _now - _first_deadline;
+      timing.pops++;
+      timing.sumTicks += _delay;
+      if(_delay > timing.maxTicks) {
+        timing.maxTicks = _delay;
+      }
+    }
+#endif
+    raw_popQueue(_half, _idx);
   }
 }
+
+/**
+ * Prints how much the planner delayed the movements that had to start on the
+ * deadline of the previous movement of the same bodypart or on their keyframe
+ * time, as Q <pops> <average us> <max us>.
+ * Nothing is printed unless SERIAL_SERVO_TIMING is enabled.
+ */
+void BodyMovement::printTiming() {
+#if SERIAL_SERVO_TIMING
+  Serial.print('Q');
+  Serial.print(' ');
+  Serial.print(timing.pops);
+  Serial.print(' ');
+  Serial.print(timing.pops ? ticksToUs(timing.sumTicks / timing.pops) : 0);
+  Serial.print(' ');
+  Serial.print(ticksToUs(timing.maxTicks));
+  Serial.println();
+#endif
+}
+
+/**
+ * Clears the planner delay statistics.
+ */
+void BodyMovement::clearTiming() {
+#if SERIAL_SERVO_TIMING
+  timing.pops = 0;
+  timing.sumTicks = 0;
+  timing.maxTicks = 0;
+#endif
+}
@@ -21,10 +21,32 @@
  * PURPOSE:
  *
  * This create an abstraction class for the robot movments.
- * This also implement a circular buffer for movements.
- * NOTE: that the buffer size need to be a power of two, as we use the AND
- * bitwise operator instead of the slow module operation to compute the next
- * index for the circular buffer.
+ * This also implement a queue of movements for each bodypart. All the queues
+ * share a single pool of blocks, each bodypart chains its own blocks from the
+ * first to the last while unused blocks are chained in a free list, so that a
+ * busy bodypart can plan many movements while the others are idle. The last
+ * POOL_RESERVE free blocks are only given to bodyparts with an empty queue,
+ * so one that plans far ahead never holds back the first movement of another.
+ * Consecutive profiled movements of a bodypart in the same direction are
+ * blended: when a movement is popped the planner looks at the next one in the
+ * queue and lets the servo pass the junction at the slower of the two average
+ * speeds instead of stopping.
+ * The planner keeps a bitmask of the bodyparts with planned movements and on
+ * every call pops all of them that are idle, in deadline order.
+ * Keyframes are movements with a start time counted from an epoch (e.g. the
+ * start of an animation) instead of the end of the previous movement, so late
+ * pops never add up.
+ * A group of bodyparts can also be moved as a single unit: their sweeps are
+ * staged and committed together, so they start on the same frame and end on
+ * the same deadline, which is also stretched to respect the top speed of the
+ * slowest bodypart.
+ * The planned movements can be dropped all at once, see clearQueue, so a
+ * stopped or replaced animation does not keep playing what it planned ahead.
+ * Blocks of the pool can be granted as credits to a host that streams the
+ * movements, see grantCredits: they are kept free for its pushCredit calls,
+ * so the host never sends a movement that does not fit.
+ * NOTE: that the pool size need to be lower than BLOCK_NONE, as blocks are
+ * chained through 8 bit indexes.
  */
 
 #ifndef _BODY_MOVEMENT_H
@@ -53,18 +75,18 @@
 #define POS_MAX                 2
 #define POS_SIZE                3
 
-#define BF_SIZE                 4
+// 45 blocks of 8 bytes, the chain indexes, the junction speeds, the counters,
+// pendingMask and the keyframe clock take 433 bytes of SRAM.
+#define POOL_SIZE              45
+#define POOL_RESERVE            4     // Kept for the bodyparts with no block.
+#define BLOCK_NONE           0xFF
+#define BLOCK_KEYFRAME       0x80     // Set in movProfile if movStart is used.
 
-#if BF_SIZE && !(BF_SIZE & (BF_SIZE - 1))   // If BF_SIZE is a power of 2
-  #define modQueue(n) ((n) & (BF_SIZE - 1))
-#else
-  #define modQueue(n) ((n) % (BF_SIZE))
-#endif
+#define blockProfile(block) ((block).movProfile & ~BLOCK_KEYFRAME)
+#define isKeyframe(block) ((block).movProfile & BLOCK_KEYFRAME)
 
-#define nextQueue(n) modQueue(n + 1)
-#define countQueue(head,tail) modQueue(head - tail + BF_SIZE)
-#define emptyQueue(head,tail) (head == tail)
-#define fullQueue(head,tail) (nextQueue(head) == tail)
+// The keyframe clock counts milliseconds from the epoch on 16 bit, so a
+// keyframe can be planned up to ~32 seconds ahead, see raw_keyClock.
 
 #define SERVO_ANGLE_POS {                                                      \
   {800,  900,  1200}, {  0,  900,  1800},                                      \
@@ -80,14 +102,33 @@
   {  -120,   10}, {  0,  0}, {  0,   0}, {  0,   0}, {  0,   0}                 \
 }
 
+// Top speed of each bodypart in angle*10 per second, see setMove.
+#define SERVO_SPEED_MAX {                                                      \
+  2000, 2000, 1500, 2000, 2000, 2500, 3000, 3000, 3000, 3000                   \
+}
+
+// Peak to average speed ratio of each sweep profile, in thousandths.
+#define SPEED_PEAK_LINEAR    1000
+#define SPEED_PEAK_TRAPEZOID 1334     // 4/3.
+#define SPEED_PEAK_SCURVE    1875     // 15/8.
+
 #define INVALID_BODY_POS 65535
 
+struct planner_timing_t {
+  uint16_t pops;
+  uint32_t sumTicks, maxTicks;
+};
+
 struct block_t {
   uint16_t movAngle, movTime;
+  uint8_t movProfile;
+  uint8_t next;
+  uint16_t movStart;
 };
 
 typedef const PROGMEM uint16_t body_pos_t;
 typedef const PROGMEM int8_t body_offset_t;
+typedef const PROGMEM uint16_t body_speed_t;
 
 class BodyMovement {
   public:
@@ -95,24 +136,43 @@ class BodyMovement {
     static bool isValidBodypart(uint8_t _idx);
     static void setPos(bool _half, uint8_t _idx, uint16_t _angle);
     static void setSweep(bool _half, uint8_t _idx, uint16_t _angle,
-                         uint16_t _time);
+                         uint16_t _time, uint8_t _profile = SWEEP_LINEAR);
+    static void setPose(const uint16_t *_angles, uint16_t _time = 0);
+    static void setMove(const uint16_t *_angles, uint16_t _time = 0,
+                        uint8_t _profile = SWEEP_LINEAR);
     static void setDefault();
     static void setDefault(bool _half, uint8_t _idx);
     static void setSequence(bool _status);
     static void setWait(bool _half, uint8_t _idx, uint16_t _time);
+    static void setTrim(bool _half, uint8_t _idx, int16_t _angle);
     static uint16_t getPos(bool _half, uint8_t _idx);
     static uint16_t getMinPos(uint8_t _idx);
     static uint16_t getDefaultPos(uint8_t _idx);
+    static int8_t getOffset(bool _half, uint8_t _idx);
     static uint16_t getMaxPos(uint8_t _idx);
+    static uint16_t getMaxSpeed(uint8_t _idx);
     static bool isMoving(bool _half, uint8_t _idx);
 
     static bool pushQueue(bool _half, uint8_t _idx, uint16_t _angle,
-                          uint16_t _time);
+                          uint16_t _time, uint8_t _profile = SWEEP_LINEAR);
+    static bool pushKeyframe(bool _half, uint8_t _idx, uint16_t _angle,
+                             uint16_t _time, uint16_t _start,
+                             uint8_t _profile = SWEEP_LINEAR);
+    static void setEpoch();
+    static void clearQueue();
     static bool popQueue(bool _half, uint8_t _idx);
     static bool isQueueFull(bool _half, uint8_t _idx);
     static bool isQueueEmpty(bool _half, uint8_t _idx);
+    static uint8_t getFreeBlocks();
+    static uint8_t getCredits();
+    static uint8_t grantCredits();
+    static void clearCredits();
+    static bool pushCredit(bool _half, uint8_t _idx, uint16_t _angle,
+                           uint16_t _time, uint8_t _profile = SWEEP_LINEAR);
 
     static void movementPlanner();
+    static void printTiming();
+    static void clearTiming();
   private:
     // No-one have to create an istance of this class as we use it as
     // a singleton, so we keep constructor as private.
@@ -124,26 +184,59 @@ class BodyMovement {
     static void raw_setPos(const bool &_half, const uint8_t &_idx,
                            const uint16_t &_angle);
     static void raw_setSweep(const bool &_half, const uint8_t &_idx,
-                             const uint16_t &_angle, const uint16_t &_time);
+                             const uint16_t &_angle, const uint16_t &_time,
+                             const uint8_t &_profile);
+    static void raw_stagePos(const bool &_half, const uint8_t &_idx,
+                             const uint16_t &_angle);
+    static void raw_stageSweep(const bool &_half, const uint8_t &_idx,
+                               const uint16_t &_angle, const uint16_t &_time,
+                               const uint8_t &_profile);
     static void raw_setDefault(const bool &_half, const uint8_t &_idx);
     static void raw_setWait(const bool &_half, const uint8_t &_idx,
                             const uint16_t &_time);
     static uint16_t raw_getPos(const bool &_half, const uint8_t &_idx);
     static uint16_t raw_getMinPos(const uint8_t &_idx);
     static uint16_t raw_getDefaultPos(const uint8_t &_idx);
+    static int8_t raw_getOffset(const bool &_half, const uint8_t &_idx);
     static uint16_t raw_getMaxPos(const uint8_t &_idx);
+    static uint16_t raw_getMaxSpeed(const uint8_t &_idx);
+    static uint32_t raw_moveTime(const uint8_t &_idx, const uint16_t &_delta,
+                                 const uint8_t &_profile);
     static bool raw_isMoving(const bool &_half, const uint8_t &_idx);
 
     static void raw_pushQueue(const bool &_half, const uint8_t &_idx,
-                              const uint16_t &_angle, const uint16_t &_time);
+                              const uint16_t &_angle, const uint16_t &_time,
+                              const uint8_t &_profile, const uint16_t &_start);
     static void raw_popQueue(const bool &_half, const uint8_t &_idx);
+    static uint8_t raw_planJunction(const bool &_half, const uint8_t &_idx,
+                                    const block_t &_block);
+    static uint8_t raw_junctionSpeed(const uint16_t &_delta_a,
+                                     const uint16_t &_time_a,
+                                     const uint16_t &_delta_b,
+                                     const uint16_t &_time_b);
+    static void raw_blendSweep(const bool &_half, const uint8_t &_idx,
+                               const uint8_t &_entry, const uint8_t &_exit);
+    static void raw_keyClock(const uint32_t &_now);
+    static uint32_t raw_keyframeTicks(const uint16_t &_start);
+    static uint32_t raw_readyTime(const uint8_t &_ch);
     static bool raw_isQueueFull(const bool &_half, const uint8_t &_idx);
     static bool raw_isQueueEmpty(const bool &_half, const uint8_t &_idx);
 
     static body_pos_t pos[HF_NUM][POS_SIZE];
     static body_offset_t offset[HF_NUM][HF_SIZE];
-    static uint8_t head[HF_SIZE][HF_NUM], tail[HF_SIZE][HF_NUM];
-    static block_t queue[HF_SIZE][HF_NUM][BF_SIZE];
+    static body_speed_t speed[HF_NUM];
+    static uint8_t first[HF_SIZE][HF_NUM], last[HF_SIZE][HF_NUM];
+    static uint8_t freeBlock;
+    static uint8_t freeBlocks, creditBlocks;
+    static uint8_t junction[HF_SIZE][HF_NUM];
+    static block_t pool[POOL_SIZE];
+    static uint32_t pendingMask;
+    static uint32_t keyClockTicks;
+    static uint16_t keyClockMs;
+#if SERIAL_SERVO_TIMING
+    static uint32_t delayMask;
+    static planner_timing_t timing;
+#endif
 };
 
 #endif
@@ -22,7 +22,10 @@
 
 #include "serialServo.h"
 #include "bodyMovement.h"
+#include "bodyKinematics.h"
 #include "animationStore.h"
+#include "motionSensor.h"
+#include "balanceController.h"
 
 /**
  * parser struct is located in SRAM momery and store information about the parsed
@@ -40,12 +43,20 @@ void CommandParser::begin() {
   for(uint8_t _cmd = _A_; _cmd <= _Z_; _cmd++) {
     parser.valueCode[_cmd] = DEFAULT_CODE_VALUE;
   }
+  parser.signCode = 0;
+  parser.listSize = 0;
+  parser.streaming = false;
 }
 
 /**
  * This routine is called by the loop and parse the serial commands.
+ * While streaming it also grants the free blocks of the movement queue to the
+ * host, see parseCodeQ2.
  */
 void CommandParser::parseSerial() {
+  if(parser.streaming) {
+    parseCredits();
+  }
   if(!parser.isBusy) {
     if(Serial.available() > 0) {
       parseByte(Serial.read());
@@ -58,6 +69,8 @@ void CommandParser::parseSerial() {
 
 /**
  * Parses a byte recived.
+ * A code can take a comma separated list of values, all but the last one are
+ * moved into listCode as soon as their comma is recived.
  *
  * @param _b a character.
  */
@@ -76,6 +89,24 @@ void CommandParser::parseByte(char _b) {
     parser.valueCode[parser.activeCode] *= 10;
     parser.valueCode[parser.activeCode] += numIdx(_b);
   }
+  else if(_b == '-') {
+    if(parser.activeCode == DEFAULT_CMD_IDX ||
+       usedCode(parser.valueCode[parser.activeCode])) {
+      return;
+    }
+    parser.signCode |= 1UL << parser.activeCode;
+  }
+  else if(_b == ',') {
+    if(parser.listSize >= CMD_LIST_SIZE - 1) {
+      parser.activeCode = DEFAULT_CMD_IDX;        // Drops the extra values.
+    }
+    if(parser.activeCode == DEFAULT_CMD_IDX) {
+      return;
+    }
+    parser.listCode[parser.listSize++] = parser.valueCode[parser.activeCode];
+    parser.valueCode[parser.activeCode] = DEFAULT_CODE_VALUE;
+    parser.signCode &= ~(1UL << parser.activeCode);  // Lists are unsigned.
+  }
   else if('A' <= _b && _b <= 'Z') {
     parser.activeCode = alpIdx(_b);
     if(usedCode(parser.valueCode[parser.activeCode])) {
@@ -96,6 +127,8 @@ void CommandParser::parseByte(char _b) {
     for(uint8_t _cmd = _A_; _cmd <= _Z_; _cmd++) {
       parser.valueCode[_cmd] = DEFAULT_CODE_VALUE;
     }
+    parser.signCode = 0;
+    parser.listSize = 0;
   }
 }
 
@@ -107,6 +140,8 @@ void CommandParser::parseCode() {
     case _S_: parseCodeS(); return;
     case _Q_: parseCodeQ(); return;
     case _C_: parseCodeC(); return;
+    case _E_: parseCodeE(); return;
+    case _I_: parseCodeI(); return;
   }
 }
 
@@ -119,6 +154,9 @@ void CommandParser::parseCodeS() {
     case 1: parseCodeS1(); return;
     case 2: parseCodeS2(); return;
     case 3: parseCodeS3(); return;
+    case 4: parseCodeS4(); return;
+    case 5: parseCodeS5(); return;
+    case 6: parseCodeS6(); return;
   }
 }
 
@@ -163,29 +201,38 @@ void CommandParser::parseCodeS1() {
 /**
  * S2
  * R<index[0-9]> or L<index[0-9]> A<angle[deg*10]> T<duration[ms]>
+ * P<profile[0-2](optional)>
  * Sweeps to a pulse width for a servo.
+ * P selects the velocity profile: 0 linear, 1 trapezoidal, 2 S-curve.
  */
 void CommandParser::parseCodeS2() {
   if((!usedCode(parser.valueCode[_L_]) && !usedCode(parser.valueCode[_R_])) ||
      !usedCode(parser.valueCode[_A_])  || !usedCode(parser.valueCode[_T_])) {
     return;
   }
+  if(!usedCode(parser.valueCode[_P_])) {
+    parser.valueCode[_P_] = SWEEP_LINEAR;
+  }
   if(usedCode(parser.valueCode[_L_])) {
     BodyMovement::setSweep(HF_L, parser.valueCode[_L_],
                                  parser.valueCode[_A_],
-                                 parser.valueCode[_T_]);
+                                 parser.valueCode[_T_],
+                                 parser.valueCode[_P_]);
   }
   else {
     BodyMovement::setSweep(HF_R, parser.valueCode[_R_],
                                  parser.valueCode[_A_],
-                                 parser.valueCode[_T_]);
+                                 parser.valueCode[_T_],
+                                 parser.valueCode[_P_]);
   }
 }
 
 /**
  * S3
- * A<animation[]> D<distance[ms]> T<duration[ms]>
- * Applies an animation.
+ * A<animation[]> D<distance[ms]> T<duration[ms]> G<amplitude[Q8](optional)>
+ * Applies an animation, the ones uploaded with E0 follow the stored ones.
+ * A stored animation is played in T, or at its own speed if T is 0, and G
+ * scales its angles around the default pose, 256 plays them as they are.
  */
 void CommandParser::parseCodeS3() {
   if(!usedCode(parser.valueCode[_A_]) ||
@@ -197,6 +244,116 @@ void CommandParser::parseCodeS3() {
   AnimationStore::applyAnimation(parser.valueCode[_A_],
                                  parser.valueCode[_D_],
                                  parser.valueCode[_T_]);
+  if(usedCode(parser.valueCode[_G_])) {
+    AnimationStore::setAmplitude(parser.valueCode[_G_]);
+  }
+}
+
+/**
+ * S4
+ * A<angle[deg*10]>,<angle[deg*10]>,... T<duration[ms](optional)>
+ * Sets a pose for all the servos, right bodyparts first. An empty or missing
+ * angle leaves its servo as it is.
+ * Without T the whole pose is written on the same frame, otherwise all the
+ * servos sweep to it in T.
+ */
+void CommandParser::parseCodeS4() {
+  if(!parseAngleList()) {
+    return;
+  }
+  if(!usedCode(parser.valueCode[_T_])) {
+    parser.valueCode[_T_] = 0;
+  }
+  BodyMovement::setPose(parser.listCode, parser.valueCode[_T_]);
+}
+
+/**
+ * S5
+ * A<angle[deg*10]>,<angle[deg*10]>,... T<duration[ms](optional)>
+ * P<profile[0-2](optional)>
+ * Moves a group of servos, right bodyparts first, as a single unit: they all
+ * start on the same frame and finish on the same frame. An empty or missing
+ * angle leaves its servo out of the group.
+ * Without T the duration is the shortest one allowed by the top speed of the
+ * slowest servo, a shorter T is stretched to it. P selects the velocity
+ * profile, see S2.
+ */
+void CommandParser::parseCodeS5() {
+  if(!parseAngleList()) {
+    return;
+  }
+  if(!usedCode(parser.valueCode[_T_])) {
+    parser.valueCode[_T_] = 0;
+  }
+  if(!usedCode(parser.valueCode[_P_])) {
+    parser.valueCode[_P_] = SWEEP_LINEAR;
+  }
+  BodyMovement::setMove(parser.listCode, parser.valueCode[_T_],
+                        parser.valueCode[_P_]);
+}
+
+/**
+ * S6
+ * R<yaw[deg*10]>|L<yaw[deg*10]> X<x[mm*10]> Y<y[mm*10]> Z<z[mm*10]>
+ * T<duration[ms](optional)> P<profile[0-2](optional)>
+ * Moves a foot to a position, with the same axes printed by I2, keeping the
+ * sole flat and turned by yaw, positive outward. Values can be negative.
+ * The six servos of the leg are moved as in S5.
+ */
+void CommandParser::parseCodeS6() {
+  if((!usedCode(parser.valueCode[_L_]) && !usedCode(parser.valueCode[_R_])) ||
+     !usedCode(parser.valueCode[_X_]) || !usedCode(parser.valueCode[_Y_]) ||
+     !usedCode(parser.valueCode[_Z_])) {
+    return;
+  }
+  if(!usedCode(parser.valueCode[_T_])) {
+    parser.valueCode[_T_] = 0;
+  }
+  if(!usedCode(parser.valueCode[_P_])) {
+    parser.valueCode[_P_] = SWEEP_LINEAR;
+  }
+  bool _half = usedCode(parser.valueCode[_L_]) ? HF_L : HF_R;
+  kin_point_t _foot;
+  _foot.x = signedCode(_X_) + (_half ? -KIN_HIP_X * 10 : KIN_HIP_X * 10);
+  _foot.y = signedCode(_Y_);
+  _foot.z = signedCode(_Z_);
+  for(parser.listSize = 0; parser.listSize < CMD_LIST_SIZE; ) {
+    parser.listCode[parser.listSize++] = INVALID_BODY_POS;
+  }
+  BodyKinematics::solveLeg(_half, _foot, signedCode(_half ? _L_ : _R_),
+                           parser.listCode + (_half ? HF_NUM : 0));
+  BodyMovement::setMove(parser.listCode, parser.valueCode[_T_],
+                        parser.valueCode[_P_]);
+}
+
+/**
+ * Completes the A list with its last value and pads it with INVALID_BODY_POS
+ * up to a value for each servo.
+ *
+ * @return false if no angle was passed, true otherwise.
+ */
+bool CommandParser::parseAngleList() {
+  if(parser.listSize == 0 && !usedCode(parser.valueCode[_A_])) {
+    return false;
+  }
+  parser.listCode[parser.listSize++] = parser.valueCode[_A_];
+  while(parser.listSize < CMD_LIST_SIZE) {
+    parser.listCode[parser.listSize++] = INVALID_BODY_POS;
+  }
+  return true;
+}
+
+/**
+ * Gets a value with the sign that was typed before it.
+ *
+ * @param _cmd code index.
+ * @return signed value.
+ */
+int16_t CommandParser::signedCode(uint8_t _cmd) {
+  if(parser.signCode & (1UL << _cmd)) {
+    return -int16_t(parser.valueCode[_cmd]);
+  }
+  return parser.valueCode[_cmd];
 }
 
 /**
@@ -206,14 +363,20 @@ void CommandParser::parseCodeQ() {
   switch(parser.valueCode[_Q_]) {
     case 0: parseCodeQ0(); return;
     case 1: parseCodeQ1(); return;
+    case 2: parseCodeQ2(); return;
   }
 }
 
 /**
  * Q0
  * R<index[0-9]> or L<index[0-9]> A<angle[deg*10](optional)> D<duration[ms]>
+ * P<profile[0-2](optional)>
  * Plans a movment for a servo.
  * If 'A' is not passed or is seted to 0 a pause will be planned instead.
+ * P selects the velocity profile, see S2.
+ * While streaming each movement takes a credit and the serial port is never
+ * held: a movement sent without credits is dropped and answered with G -.
+ * Otherwise the parser waits for a free block, and reads nothing meanwhile.
  */
 void CommandParser::parseCodeQ0() {
   if((!usedCode(parser.valueCode[_L_]) && !usedCode(parser.valueCode[_R_])) ||
@@ -223,10 +386,28 @@ void CommandParser::parseCodeQ0() {
   if(!usedCode(parser.valueCode[_A_])) {
     parser.valueCode[_A_] = 0;
   }
+  if(!usedCode(parser.valueCode[_P_])) {
+    parser.valueCode[_P_] = SWEEP_LINEAR;
+  }
+  if(parser.streaming) {
+    bool _half = usedCode(parser.valueCode[_L_]) ? HF_L : HF_R;
+    bool _inserted =
+      BodyMovement::pushCredit(_half, parser.valueCode[_half ? _L_ : _R_],
+                               parser.valueCode[_A_], parser.valueCode[_D_],
+                               parser.valueCode[_P_]);
+    if(!_inserted) {
+      Serial.print('G');
+      Serial.print(' ');
+      Serial.print('-');
+      Serial.println();
+    }
+    return;
+  }
   if(usedCode(parser.valueCode[_L_])) {
     bool _inserted = BodyMovement::pushQueue(HF_L, parser.valueCode[_L_],
                                                    parser.valueCode[_A_],
-                                                   parser.valueCode[_D_]);
+                                                   parser.valueCode[_D_],
+                                                   parser.valueCode[_P_]);
     if(!_inserted) {
       parser.isBusy = true;
       return;
@@ -235,7 +416,8 @@ void CommandParser::parseCodeQ0() {
   else {
     bool _inserted = BodyMovement::pushQueue(HF_R, parser.valueCode[_R_],
                                                    parser.valueCode[_A_],
-                                                   parser.valueCode[_D_]);
+                                                   parser.valueCode[_D_],
+                                                   parser.valueCode[_P_]);
     if(!_inserted) {
       parser.isBusy = true;
       return;
@@ -257,12 +439,53 @@ void CommandParser::parseCodeQ1() {
   }
 }
 
+/**
+ * Q2
+ * E<enable[0-1]>
+ * Starts or stops streaming the Q0 codes. While streaming the firmware grants
+ * the free blocks of the movement queue as credits, with lines G <credits>,
+ * and the host sends a Q0 only for a credit it holds, so the parser never
+ * waits and the other commands are read at once.
+ * Starting takes back the credits granted before and grants the free blocks
+ * at once, the host has to drop its own count and start from that line.
+ */
+void CommandParser::parseCodeQ2() {
+  if(!usedCode(parser.valueCode[_E_])) {
+    return;
+  }
+  BodyMovement::clearCredits();
+  parser.streaming = parser.valueCode[_E_];
+  if(parser.streaming) {
+    Serial.print('G');
+    Serial.print(' ');
+    Serial.print(BodyMovement::grantCredits());
+    Serial.println();
+  }
+}
+
+/**
+ * Grants the free blocks of the movement queue, at least CMD_CREDIT_BATCH at
+ * once to keep the serial line quiet. The host never starves, when fewer
+ * blocks are free all the others are planned movements.
+ */
+void CommandParser::parseCredits() {
+  if(BodyMovement::getFreeBlocks() < CMD_CREDIT_BATCH) {
+    return;
+  }
+  Serial.print('G');
+  Serial.print(' ');
+  Serial.print(BodyMovement::grantCredits());
+  Serial.println();
+}
+
 /**
  * Parses the C codes.
  */
 void CommandParser::parseCodeC() {
   switch(parser.valueCode[_C_]) {
     case 0: parseCodeC0(); return;
+    case 1: parseCodeC1(); return;
+    case 2: parseCodeC2(); return;
   }
 }
 
@@ -284,4 +507,228 @@ void CommandParser::parseCodeC0() {
     _ch = parser.valueCode[_R_];
   }
   SerialServo::writeWidth(_ch, parser.valueCode[_W_], false, true);
-}
\ No newline at end of file
+}
+
+/**
+ * C1
+ * F<rate[Hz]>
+ * Sets how many times each second the motion sensor is read, 0 stops it.
+ */
+void CommandParser::parseCodeC1() {
+  if(!usedCode(parser.valueCode[_F_])) {
+    return;
+  }
+  MotionSensor::setRate(parser.valueCode[_F_]);
+}
+
+/**
+ * C2
+ * E<enable[0-1]> P<gain> D<gain> H<hip share> (all optional)
+ * Sets the gains of the balance and enables or disables it, see
+ * BalanceController::setGain. Omitted values are left as they are.
+ */
+void CommandParser::parseCodeC2() {
+  if(usedCode(parser.valueCode[_P_])) {
+    BalanceController::setGain(BALANCE_GAIN_P, parser.valueCode[_P_]);
+  }
+  if(usedCode(parser.valueCode[_D_])) {
+    BalanceController::setGain(BALANCE_GAIN_D, parser.valueCode[_D_]);
+  }
+  if(usedCode(parser.valueCode[_H_])) {
+    BalanceController::setGain(BALANCE_GAIN_HIP, parser.valueCode[_H_]);
+  }
+  if(usedCode(parser.valueCode[_E_])) {
+    BalanceController::setEnabled(parser.valueCode[_E_]);
+  }
+}
+
+/**
+ * Parses the E codes.
+ * Each command but E3 answers E <free bytes> when it is done or E - when it
+ * fails, an uploader should wait for the answer before sending the next one.
+ * E1 and E2 answer once their EEPROM writes have ended, holding the parser
+ * meanwhile, see waitCodeE.
+ */
+void CommandParser::parseCodeE() {
+  switch(parser.valueCode[_E_]) {
+    case 0: parseCodeE0(); return;
+    case 1: parseCodeE1(); return;
+    case 2: parseCodeE2(); return;
+    case 3: parseCodeE3(); return;
+    case 4: parseCodeE4(); return;
+  }
+}
+
+/**
+ * E0
+ * A<slot[0-7]> S<start steps> P<loop steps> N<end steps>
+ * Opens the upload of an animation into an EEPROM slot, replacing the one that
+ * was there once it is closed. It is played by S3 as the animation
+ * ANIM_SIZE + slot. It fails while the EEPROM is compacted, see E4.
+ */
+void CommandParser::parseCodeE0() {
+  if(!usedCode(parser.valueCode[_A_]) || !usedCode(parser.valueCode[_S_]) ||
+     !usedCode(parser.valueCode[_P_]) || !usedCode(parser.valueCode[_N_]) ||
+     parser.valueCode[_S_] > ANIM_EE_MAX_STEPS ||
+     parser.valueCode[_P_] > ANIM_EE_MAX_STEPS ||
+     parser.valueCode[_N_] > ANIM_EE_MAX_STEPS) {
+    return replyCodeE(false);
+  }
+  replyCodeE(AnimationStore::beginUpload(parser.valueCode[_A_],
+                                         parser.valueCode[_S_],
+                                         parser.valueCode[_P_],
+                                         parser.valueCode[_N_]));
+}
+
+/**
+ * E1
+ * R<index[0-9]> or L<index[0-9]> A<angle[deg*10](optional)> D<duration[ms]>
+ * Uploads the next step of the open upload.
+ * If 'A' is not passed a pause of the bodypart is uploaded instead, as in Q0.
+ */
+void CommandParser::parseCodeE1() {
+  if(parser.isBusy) {
+    return waitCodeE();
+  }
+  if((!usedCode(parser.valueCode[_L_]) && !usedCode(parser.valueCode[_R_])) ||
+     !usedCode(parser.valueCode[_D_])) {
+    return replyCodeE(false);
+  }
+  if(!usedCode(parser.valueCode[_A_])) {
+    parser.valueCode[_A_] = INVALID_BODY_POS;
+  }
+  bool _half = usedCode(parser.valueCode[_L_]) ? HF_L : HF_R;
+  if(!AnimationStore::uploadStep(_half, parser.valueCode[_half ? _L_ : _R_],
+                                 parser.valueCode[_A_],
+                                 parser.valueCode[_D_])) {
+    return replyCodeE(false);
+  }
+  waitCodeE();
+}
+
+/**
+ * E2
+ * Closes the upload, it fails if some steps are missing.
+ */
+void CommandParser::parseCodeE2() {
+  if(parser.isBusy) {
+    return waitCodeE();
+  }
+  if(!AnimationStore::endUpload()) {
+    return replyCodeE(false);
+  }
+  waitCodeE();
+}
+
+/**
+ * E3
+ * Lists the animations in the EEPROM, see AnimationStore::printStored.
+ */
+void CommandParser::parseCodeE3() {
+  AnimationStore::printStored();
+}
+
+/**
+ * E4
+ * A<slot[0-7]>
+ * Deletes an animation from the EEPROM. The ones after it are then moved down
+ * in the background, E0 and E4 fail until they are.
+ */
+void CommandParser::parseCodeE4() {
+  if(!usedCode(parser.valueCode[_A_])) {
+    return replyCodeE(false);
+  }
+  replyCodeE(AnimationStore::deleteAnimation(parser.valueCode[_A_]));
+}
+
+/**
+ * Answers an E code once the EEPROM writes it started have ended. Until then
+ * the parser is busy, so the command is parsed again at every loop and the
+ * next ones wait in the receive buffer.
+ */
+void CommandParser::waitCodeE() {
+  parser.isBusy = AnimationStore::isWriting();
+  if(!parser.isBusy) {
+    replyCodeE(true);
+  }
+}
+
+/**
+ * Answers an E code.
+ *
+ * @param _done true if the command was done.
+ */
+void CommandParser::replyCodeE(bool _done) {
+  Serial.print('E');
+  Serial.print(' ');
+  if(_done) {
+    Serial.print(AnimationStore::getFree());
+  }
+  else {
+    Serial.print('-');
+  }
+  Serial.println();
+}
+
+/**
+ * Parses the I codes.
+ */
+void CommandParser::parseCodeI() {
+  switch(parser.valueCode[_I_]) {
+    case 0: parseCodeI0(); return;
+    case 1: parseCodeI1(); return;
+    case 2: parseCodeI2(); return;
+    case 3: parseCodeI3(); return;
+  }
+}
+
+/**
+ * I0
+ * Prints the servo interrupt timing statistics, the planner delays, the
+ * kinematics update time, the motion sensor time, the balance update time and
+ * the animation step read time.
+ * It needs SERIAL_SERVO_TIMING to be enabled, see SerialServo::printTiming,
+ * BodyMovement::printTiming, BodyKinematics::printTiming,
+ * MotionSensor::printTiming, BalanceController::printTiming and
+ * AnimationStore::printTiming.
+ */
+void CommandParser::parseCodeI0() {
+  SerialServo::printTiming();
+  BodyMovement::printTiming();
+  BodyKinematics::printTiming();
+  MotionSensor::printTiming();
+  BalanceController::printTiming();
+  AnimationStore::printTiming();
+}
+
+/**
+ * I1
+ * Clears the servo interrupt timing statistics, the planner delays, the
+ * kinematics update time, the motion sensor time, the balance update time and
+ * the animation step read time.
+ */
+void CommandParser::parseCodeI1() {
+  SerialServo::clearTiming();
+  BodyMovement::clearTiming();
+  BodyKinematics::clearTiming();
+  MotionSensor::clearTiming();
+  BalanceController::clearTiming();
+  AnimationStore::clearTiming();
+}
+
+/**
+ * I2
+ * Prints the position of the feet, of the hands and of the COM, see
+ * BodyKinematics::printPosition.
+ */
+void CommandParser::parseCodeI2() {
+  BodyKinematics::printPosition();
+}
+
+/**
+ * I3
+ * Prints the pitch and the roll of the trunk, see MotionSensor::printAttitude.
+ */
+void CommandParser::parseCodeI3() {
+  MotionSensor::printAttitude();
+}
@@ -27,12 +27,31 @@
  * S1 - Set a angle width for a servo.
  * S2 - Sweep to an angle for a servo.
  * S3 - Apply an animation.
+ * S4 - Set a pose for all the servos.
+ * S5 - Move a group of servos together.
+ * S6 - Move a foot to a position.
  *
  * Implemented Q codes:
  * Q0 - Plan a movment for a servo.
+ * Q2 - Start or stop streaming the Q0 codes with credits.
  *
  * Implemented C codes:
  * C0 - Calibrate servo bound.
+ * C1 - Set the motion sensor rate.
+ * C2 - Set the balance gains and enable it.
+ *
+ * Implemented E codes:
+ * E0 - Open the upload of an animation into the EEPROM.
+ * E1 - Upload a step.
+ * E2 - Close the upload.
+ * E3 - List the animations in the EEPROM.
+ * E4 - Delete an animation from the EEPROM.
+ *
+ * Implemented I codes:
+ * I0 - Print the servo interrupt timing statistics.
+ * I1 - Clear the servo interrupt timing statistics.
+ * I2 - Print the position of the feet, of the hands and of the COM.
+ * I3 - Print the pitch and the roll of the trunk.
  */
  
 #ifndef _COMMAND_PARSER_H
@@ -41,6 +60,8 @@
 #define SERIAL_BAUD         115200
 #define DEFAULT_CMD_IDX        255
 #define DEFAULT_CODE_VALUE   65535
+#define CMD_LIST_SIZE           20     // One value for each servo.
+#define CMD_CREDIT_BATCH         8     // Fewest credits granted at once.
 
 #define numIdx(num) num-'0'
 #define alpIdx(chr) chr-'A'
@@ -75,8 +96,12 @@
 
 struct cmd_t {
   bool isBusy;
+  bool streaming;                     // Q0 codes use credits, see Q2.
   uint8_t firstCode, activeCode;
   uint16_t valueCode[_Z_ + 1];
+  uint32_t signCode;                  // One bit for each negative value.
+  uint8_t listSize;
+  uint16_t listCode[CMD_LIST_SIZE];
 };
 
 class CommandParser {
@@ -96,13 +121,37 @@ class CommandParser {
     static void parseCodeS1();
     static void parseCodeS2();
     static void parseCodeS3();
+    static void parseCodeS4();
+    static void parseCodeS5();
+    static void parseCodeS6();
+    static bool parseAngleList();
+    static int16_t signedCode(uint8_t _cmd);
     
     static void parseCodeQ();
     static void parseCodeQ0();
     static void parseCodeQ1();
+    static void parseCodeQ2();
+    static void parseCredits();
     
     static void parseCodeC();
     static void parseCodeC0();
+    static void parseCodeC1();
+    static void parseCodeC2();
+
+    static void parseCodeE();
+    static void parseCodeE0();
+    static void parseCodeE1();
+    static void parseCodeE2();
+    static void parseCodeE3();
+    static void parseCodeE4();
+    static void waitCodeE();
+    static void replyCodeE(bool _done);
+
+    static void parseCodeI();
+    static void parseCodeI0();
+    static void parseCodeI1();
+    static void parseCodeI2();
+    static void parseCodeI3();
     
     static cmd_t parser;
 };
@@ -0,0 +1,199 @@
+/**
+ * Part of RoboPrime Firmware.
+ *
+ * GaitGenerator.cpp
+ * Robot procedural walks.
+ *
+ * RoboPrime Firmware, (https://github.com/simonepri/RoboPrime)
+ * Copyright (c) 2015, Simone Primarosa, (https://simoneprimarosa.com)
+ *
+ * Licensed under The MIT License
+ * Redistribution of file must retain the above copyright notice.
+ *
+ * @copyright     Copyright (c) 2015, Simone Primarosa, (https://simoneprimarosa.com)
+ * @link          (https://github.com/simonepri/RoboPrime)
+ * @since         0.0.0
+ * @require       SerialServo, BodyMovement, BodyKinematics
+ * @license       MIT License (https://opensource.org/licenses/MIT)
+ */
+
+#include "Arduino.h"
+#include "serialServo.h"
+#include "bodyMovement.h"
+#include "bodyKinematics.h"
+
+#include "gaitGenerator.h"
+
+/**
+ * motion array is located in FLASH momery and store the direction of the
+ * translation and of the rotation of each walk.
+ */
+gait_motion_t
+  GaitGenerator::motion[GAIT_WALKS][GAIT_SIZE] = GAIT_MOTION;
+
+/**
+ * gait struct is located in SRAM momery and store the parameters of the
+ * current walk.
+ */
+gait_t
+  GaitGenerator::gait;
+
+/**
+ * pose array is located in SRAM momery and store the angles of the leg
+ * bodyparts computed for the current sample.
+ */
+uint16_t
+  GaitGenerator::pose[HF_SIZE][GAIT_LEG];
+
+/**
+ * Sets up a walk.
+ * With a distance the steps are shortened so that it is walked with a whole
+ * number of them, at least two. With a duration the samples are shortened or
+ * stretched to fit it, down to GAIT_SAMPLE_MIN_MS. Without both the walk goes
+ * on until it is stopped.
+ *
+ * @param _gait animation id, from ANIM_FWW to ANIM_CCWCW.
+ * @param _dist cm to walk, or degrees to turn for the standstill rotations,
+ *              0 for none.
+ * @param _time ms the whole walk should take, 0 for none.
+ */
+void GaitGenerator::setGait(uint8_t _gait, uint16_t _dist, uint16_t _time) {
+  int8_t _x = pgm_read_byte_near(&(motion[_gait][GAIT_X]));
+  int8_t _y = pgm_read_byte_near(&(motion[_gait][GAIT_Y]));
+  int8_t _turn = pgm_read_byte_near(&(motion[_gait][GAIT_TURN_DIR]));
+  bool _walk = _x || _y;
+  uint16_t _size = _walk ? (_x ? GAIT_SIDE_STEP : GAIT_STEP) : GAIT_TURN;
+  uint32_t _steps = GAIT_ENDLESS;
+  if(_dist) {
+    uint32_t _total = uint32_t(_dist) * (_walk ? 100 : 10);
+    _steps = (_total + _size - 1) / _size;
+    if(_steps < 2) {
+      _steps = 2;
+    }
+    if(_steps >= GAIT_ENDLESS) {
+      _steps = GAIT_ENDLESS - 1;
+    }
+    _size = _total / _steps;
+  }
+  else if(_time) {
+    // Two samples to stand, then the first and the last step.
+    _steps = _time / GAIT_SAMPLE_MS / GAIT_PHASES;
+    if(_steps < 3) {
+      _steps = 3;
+    }
+    _steps -= 1;
+  }
+  gait.sampleTime = GAIT_SAMPLE_MS;
+  if(_time && _steps != GAIT_ENDLESS) {
+    gait.sampleTime = _time / (2 + GAIT_PHASES * (_steps + 1));
+    if(gait.sampleTime < GAIT_SAMPLE_MIN_MS) {
+      gait.sampleTime = GAIT_SAMPLE_MIN_MS;
+    }
+  }
+  gait.stepX = _walk ? _x * _size : 0;
+  gait.stepY = _walk ? _y * _size : 0;
+  gait.stepTurn = _turn * (_walk ? GAIT_TURN : _size);
+  gait.steps = _steps == GAIT_ENDLESS ? GAIT_ENDLESS : _steps - 1;
+  gait.swing = HF_L;
+}
+
+/**
+ * Computes a step of the current walk for AnimationStore. Every GAIT_JOINTS
+ * steps a new sample of the walk is computed.
+ * Queued movements are not corrected by the bodypart offsets, so the offset
+ * is added here.
+ *
+ * @param _step step index, see GAIT_START_STEPS.
+ * @param _half right or left body part.
+ * @param _idx body part index.
+ * @param _angle angle*10 to set.
+ * @param _time duration of the movement.
+ * @return true if this was the last step of the last looped step.
+ */
+bool GaitGenerator::nextStep(uint8_t _step, bool &_half, uint8_t &_idx,
+                             uint16_t &_angle, uint16_t &_time) {
+  uint8_t _joint = _step % GAIT_JOINTS;
+  if(!_joint) {
+    raw_sample(_step / GAIT_JOINTS);
+  }
+  _half = _joint / GAIT_LEG;
+  _idx = _joint % GAIT_LEG;
+  _angle = pose[_half][_idx] + BodyMovement::getOffset(_half, _idx);
+  _time = gait.sampleTime;
+  return _step == GAIT_START_STEPS + GAIT_LOOP_STEPS - 1 && !gait.steps;
+}
+
+/**
+ * Computes the angles of the leg bodyparts for a sample.
+ * The first sample puts the feet together below the hips, then each step
+ * moves the swinging foot from the first to the second position, in half
+ * steps, while the other foot goes the opposite way. The last sample is the
+ * default position.
+ *
+ * @param _sample sample index.
+ */
+inline void GaitGenerator::raw_sample(const uint8_t &_sample) {
+  int16_t _from = 0, _to = 0;
+  uint8_t _phase = 0;
+  if(_sample > 3 * GAIT_PHASES) {
+    for(uint8_t _idx = 0; _idx < GAIT_LEG; _idx++) {
+      pose[HF_R][_idx] = pose[HF_L][_idx] = BodyMovement::getDefaultPos(_idx);
+    }
+    return;
+  }
+  if(_sample > 2 * GAIT_PHASES) {
+    _from = -1;
+    _phase = _sample - 2 * GAIT_PHASES;
+  }
+  else if(_sample > GAIT_PHASES) {
+    _from = -1;
+    _to = 1;
+    _phase = _sample - GAIT_PHASES;
+    if(_phase == 1 && gait.steps != GAIT_ENDLESS) {
+      gait.steps--;
+    }
+  }
+  else if(_sample) {
+    _to = 1;
+    _phase = _sample;
+  }
+  if(_phase == 1) {
+    gait.swing = !gait.swing;
+  }
+  raw_foot(HF_R, _from, _to, _phase);
+  raw_foot(HF_L, _from, _to, _phase);
+}
+
+/**
+ * Computes the angles of a leg for a sample.
+ *
+ * @param _half right or left body part.
+ * @param _from position of the swinging foot at the start of the step, in
+ *              half steps from the middle.
+ * @param _to position of the swinging foot at the end of the step.
+ * @param _phase sample of the step, from 0 to GAIT_PHASES.
+ */
+inline void GaitGenerator::raw_foot(const bool &_half, const int16_t &_from,
+                                    const int16_t &_to, const uint8_t &_phase) {
+  bool _swinging = _half == gait.swing;
+  // Position along the step in half steps * GAIT_PHASES.
+  int16_t _along = _from * GAIT_PHASES + (_to - _from) * _phase;
+  if(!_swinging) {
+    _along = -_along;
+  }
+  int16_t _arc = BodyKinematics::sine(1800 / GAIT_PHASES * _phase);
+  int16_t _turn = int32_t(gait.stepTurn) * _along / (2 * GAIT_PHASES);
+  int16_t _hip = _half ? KIN_HIP_X * 10 : -KIN_HIP_X * 10;
+  kin_point_t _foot;
+  _foot.x = ((int32_t(_hip) * BodyKinematics::cosine(_turn)) >> KIN_FRACT_BITS)
+            - _hip + int32_t(gait.stepX) * _along / (2 * GAIT_PHASES) +
+            ((int32_t(gait.swing ? GAIT_SWAY : -GAIT_SWAY) * _arc) >>
+             KIN_FRACT_BITS);
+  _foot.y = -((int32_t(_hip) * BodyKinematics::sine(_turn)) >> KIN_FRACT_BITS)
+            + int32_t(gait.stepY) * _along / (2 * GAIT_PHASES);
+  _foot.z = GAIT_STANCE;
+  if(_swinging) {
+    _foot.z += (int32_t(GAIT_HEIGHT) * _arc) >> KIN_FRACT_BITS;
+  }
+  BodyKinematics::solveLeg(_half, _foot, _half ? _turn : -_turn, pose[_half]);
+}
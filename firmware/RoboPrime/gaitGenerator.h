@@ -0,0 +1,106 @@
+/**
+ * Part of RoboPrime Firmware.
+ *
+ * GaitGenerator.h
+ * Robot procedural walks.
+ *
+ * RoboPrime Firmware, (https://github.com/simonepri/RoboPrime)
+ * Copyright (c) 2015, Simone Primarosa, (https://simoneprimarosa.com)
+ *
+ * Licensed under The MIT License
+ * Redistribution of file must retain the above copyright notice.
+ *
+ * @copyright     Copyright (c) 2015, Simone Primarosa, (https://simoneprimarosa.com)
+ * @link          (https://github.com/simonepri/RoboPrime)
+ * @since         0.0.0
+ * @require       SerialServo, BodyMovement, BodyKinematics
+ * @license       MIT License (https://opensource.org/licenses/MIT)
+ */
+
+/*
+ * PURPOSE:
+ *
+ * This create a class that computes the steps of the walking animations on
+ * the fly, instead of reading them from a table in FLASH memory.
+ * A walk is a sequence of steps: in each step one foot swings forward while
+ * the other one pushes the body, then the feet swap. Each step is sampled
+ * GAIT_PHASES times: at each sample the position of both feet is computed
+ * and turned into the angles of the leg bodyparts by BodyKinematics::solveLeg,
+ * then the 12 angles are handed to AnimationStore as keyframes.
+ * A foot moves along the step by a translation and a rotation around the
+ * middle of the hips, GAIT_MOTION gives their direction for each walk, so the
+ * forward, backward, side, standstill rotation and curved walks are the same
+ * code. While a foot swings it is lifted by GAIT_HEIGHT and the body sways
+ * over the other foot by GAIT_SWAY.
+ * The first step starts with the feet together and the last one brings them
+ * together again, see GAIT_START_STEPS and GAIT_END_STEPS.
+ */
+
+#ifndef _GAIT_GENERATOR_H
+#define _GAIT_GENERATOR_H
+
+#define GAIT_PHASES             4     // Samples of each step.
+#define GAIT_JOINTS            12     // Leg bodyparts of both halves.
+#define GAIT_LEG                6     // From PART_ANKLE_X_ROT to PART_HIP_Z_ROT.
+
+// AnimationStore steps: the stance sample and the first step, the looped
+// step, the last step and the default position.
+#define GAIT_START_STEPS    (GAIT_JOINTS * (1 + GAIT_PHASES))
+#define GAIT_LOOP_STEPS     (GAIT_JOINTS * GAIT_PHASES)
+#define GAIT_END_STEPS      (GAIT_JOINTS * (GAIT_PHASES + 1))
+
+#define GAIT_STEP             200     // mm*10 walked by each step.
+#define GAIT_SIDE_STEP        100     // mm*10 walked sideways by each step.
+#define GAIT_TURN             100     // angle*10 turned by each step.
+#define GAIT_HEIGHT           150     // mm*10 a swinging foot is lifted.
+#define GAIT_SWAY             100     // mm*10 the body sways over the foot.
+#define GAIT_STANCE         -1600     // mm*10 of the feet below the hips.
+#define GAIT_SAMPLE_MS        200     // Duration of a sample.
+#define GAIT_SAMPLE_MIN_MS     80     // Shortest sample a T can ask for.
+#define GAIT_PROFILE SWEEP_SCURVE     // Samples going on the same way blend.
+#define GAIT_ENDLESS       0xFFFF     // Steps of a walk without D and T.
+
+#define GAIT_X                  0
+#define GAIT_Y                  1
+#define GAIT_TURN_DIR           2
+#define GAIT_SIZE               3
+
+// Direction of the translation and of the rotation of each walk, indexed by
+// the animation id, from ANIM_FWW to ANIM_CCWCW. X is left, turns are
+// counterclockwise seen from above.
+#define GAIT_MOTION {                                                          \
+  { 0,  1,  0}, { 0, -1,  0}, {-1,  0,  0}, { 1,  0,  0},                      \
+  { 0,  0, -1}, { 0,  0,  1}, { 0,  1, -1}, { 0,  1,  1}                       \
+}
+
+#define GAIT_WALKS              8
+
+struct gait_t {
+  int16_t stepX, stepY, stepTurn;     // Motion of a step, mm*10 and angle*10.
+  uint16_t steps;                     // Looped steps left.
+  uint16_t sampleTime;
+  bool swing;                         // Half of the swinging foot.
+};
+
+typedef const PROGMEM int8_t gait_motion_t;
+
+class GaitGenerator {
+  public:
+    static void setGait(uint8_t _gait, uint16_t _dist, uint16_t _time);
+    static bool nextStep(uint8_t _step, bool &_half, uint8_t &_idx,
+                         uint16_t &_angle, uint16_t &_time);
+  private:
+    // No-one have to create an istance of this class as we use it as
+    // a singleton, so we keep constructor as private.
+    GaitGenerator();
+
+    static void raw_sample(const uint8_t &_sample);
+    static void raw_foot(const bool &_half, const int16_t &_from,
+                         const int16_t &_to, const uint8_t &_phase);
+
+    static gait_motion_t motion[GAIT_WALKS][GAIT_SIZE];
+    static gait_t gait;
+    static uint16_t pose[HF_SIZE][GAIT_LEG];
+};
+
+#endif
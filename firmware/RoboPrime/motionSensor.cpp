@@ -0,0 +1,384 @@
+/**
+ * Part of RoboPrime Firmware.
+ *
+ * MotionSensor.cpp
+ * Interrupt driven MPU-6050 driver.
+ *
+ * RoboPrime Firmware, (https://github.com/simonepri/RoboPrime)
+ * Copyright (c) 2015, Simone Primarosa, (https://simoneprimarosa.com)
+ *
+ * Licensed under The MIT License
+ * Redistribution of file must retain the above copyright notice.
+ *
+ * @copyright     Copyright (c) 2015, Simone Primarosa, (https://simoneprimarosa.com)
+ * @link          (https://github.com/simonepri/RoboPrime)
+ * @since         0.0.0
+ * @require       SerialServo, BodyKinematics
+ * @license       MIT License (https://opensource.org/licenses/MIT)
+ */
+
+#include "Arduino.h"
+#include <util/twi.h>
+#include "serialServo.h"
+#include "bodyMovement.h"
+#include "bodyKinematics.h"
+
+#include "motionSensor.h"
+
+/**
+ * setup array is located in FLASH momery and store the register writes sent
+ * to the sensor at startup.
+ */
+mpu_setup_t
+  MotionSensor::setup[MPU_SETUP_SIZE][2] = MPU_SETUP;
+
+/**
+ * twi struct is located in SRAM momery and store the state of the bus
+ * transaction shared with the TWI interrupt.
+ */
+volatile twi_t
+  MotionSensor::twi;
+
+/**
+ * burst array is located in SRAM momery and store the last two bursts read,
+ * front is the one completed last and the other one is filled by the TWI
+ * interrupt.
+ */
+uint8_t
+  MotionSensor::burst[2][MPU_BURST_SIZE];
+volatile uint8_t
+  MotionSensor::front;
+volatile bool
+  MotionSensor::fresh;
+
+/**
+ * mpu struct is located in SRAM momery and store the sensor state and the
+ * filtered angles.
+ */
+mpu_t
+  MotionSensor::mpu;
+
+#if SERIAL_SERVO_TIMING
+/**
+ * isrTicks and timing are located in SRAM momery and store how long the TWI
+ * interrupts of a burst and the filter took.
+ */
+volatile uint16_t
+  MotionSensor::isrTicks;
+mpu_timing_t
+  MotionSensor::timing;
+#endif
+
+/**
+ * Initializes class's fields and the TWI peripheral.
+ */
+void MotionSensor::begin() {
+  TWSR = 0;                                     // Prescaler 1.
+  TWBR = (F_CPU / MPU_TWI_HZ - 16) / 2;
+  TWCR = _BV(TWEN);
+  twi.state = TWI_IDLE;
+  twi.errors = 0;
+  front = 0;
+  fresh = false;
+  mpu.ready = false;
+  mpu.setup = 0;
+  mpu.rate = MPU_RATE_HZ;
+  mpu.errors = 0;
+  mpu.lastBurst = SerialServo::readClock();
+  clearTiming();
+}
+
+/**
+ * Filters the last burst and starts the next transaction, once every
+ * 1/rate seconds for the bursts. Returns at once while the bus is busy, and
+ * drops the transaction if it is busy for longer than MPU_TWI_TIMEOUT_US.
+ */
+void MotionSensor::sensorRoutine() {
+  if(twi.state != TWI_IDLE) {
+    if(SerialServo::readClock() - twi.start >= usToTicks(MPU_TWI_TIMEOUT_US)) {
+      raw_abort();
+    }
+    return;
+  }
+  if(!mpu.rate) {
+    return;
+  }
+  if(twi.errors != mpu.errors) {
+    mpu.errors = twi.errors;                    // Sends the setup again.
+    mpu.setup = 0;
+    mpu.ready = false;
+    fresh = false;
+  }
+  if(fresh) {
+    fresh = false;
+    raw_filter();
+  }
+  uint32_t _now = SerialServo::readClock();
+  bool _due = _now - mpu.lastBurst >= msToTicks(1000) / mpu.rate;
+  if(mpu.setup < MPU_SETUP_SIZE) {
+    if(mpu.setup || _due) {
+      if(!mpu.setup) {
+        mpu.lastBurst = _now;
+      }
+      raw_start(TWI_WRITE, pgm_read_byte_near(&(setup[mpu.setup][0])),
+                pgm_read_byte_near(&(setup[mpu.setup][1])));
+      mpu.setup++;
+    }
+    return;
+  }
+  if(_due) {
+    mpu.lastBurst = _now;
+    raw_start(TWI_READ, MPU_REG_ACCEL_XOUT_H, 0);
+  }
+}
+
+/**
+ * Sets how many bursts are read each second.
+ *
+ * @param _rate bursts per second, 0 stops the readings.
+ */
+void MotionSensor::setRate(uint16_t _rate) {
+  if(_rate > MPU_RATE_MAX) {
+    _rate = MPU_RATE_MAX;
+  }
+  mpu.rate = _rate;
+}
+
+/**
+ * Checks if the angles have been computed at least once since the sensor was
+ * set up.
+ *
+ * @return true if the angles are valid.
+ */
+bool MotionSensor::isReady() {
+  return mpu.ready;
+}
+
+/**
+ * Gets the pitch of the trunk.
+ *
+ * @return angle*10, positive leaning forward.
+ */
+int16_t MotionSensor::getPitch() {
+  return (mpu.pitch + (1 << (MPU_FRACT_BITS - 1))) >> MPU_FRACT_BITS;
+}
+
+/**
+ * Gets the roll of the trunk.
+ *
+ * @return angle*10, positive leaning to the left.
+ */
+int16_t MotionSensor::getRoll() {
+  return (mpu.roll + (1 << (MPU_FRACT_BITS - 1))) >> MPU_FRACT_BITS;
+}
+
+/**
+ * Prints the angles of the trunk as A <pitch> <roll> <bus errors>, with the
+ * angles in angle*10, or A - - <bus errors> if they are not valid yet.
+ */
+void MotionSensor::printAttitude() {
+  Serial.print('A');
+  Serial.print(' ');
+  if(mpu.ready) {
+    Serial.print(getPitch());
+    Serial.print(' ');
+    Serial.print(getRoll());
+  }
+  else {
+    Serial.print("- -");
+  }
+  Serial.print(' ');
+  Serial.print(mpu.errors);
+  Serial.println();
+}
+
+/**
+ * Prints how long the sensor took, as M <bursts> <TWI interrupts us per
+ * burst> <average filter us> <max filter us>.
+ * Nothing is printed unless SERIAL_SERVO_TIMING is enabled.
+ */
+void MotionSensor::printTiming() {
+#if SERIAL_SERVO_TIMING
+  Serial.print('M');
+  Serial.print(' ');
+  Serial.print(timing.samples);
+  Serial.print(' ');
+  Serial.print(timing.samples ? ticksToUs(timing.isrTicks / timing.samples) : 0);
+  Serial.print(' ');
+  Serial.print(timing.samples ? ticksToUs(timing.sumTicks / timing.samples) : 0);
+  Serial.print(' ');
+  Serial.print(ticksToUs(timing.maxTicks));
+  Serial.println();
+#endif
+}
+
+/**
+ * Clears the sensor time statistics.
+ */
+void MotionSensor::clearTiming() {
+#if SERIAL_SERVO_TIMING
+  timing.samples = 0;
+  timing.isrTicks = 0;
+  timing.sumTicks = 0;
+  timing.maxTicks = 0;
+#endif
+}
+
+/**
+ * Moves the bus transaction one step further, called at each TWI event.
+ * A write sends the register address and one value, a read sends the
+ * register address, then restarts and reads a whole burst, acknowledging all
+ * the bytes but the last one. Any other event ends the transaction.
+ */
+inline void MotionSensor::TWI_ISR() {
+#if SERIAL_SERVO_TIMING
+  uint16_t _entry = TCNT1;
+#endif
+  uint8_t _control = _BV(TWEN) | _BV(TWIE) | _BV(TWINT);
+  switch(TW_STATUS) {
+    case TW_START:
+    case TW_REP_START:
+      TWDR = (MPU_ADDRESS << 1) | (twi.pointed ? TW_READ : TW_WRITE);
+      break;
+    case TW_MT_SLA_ACK:
+      TWDR = twi.reg;
+      twi.pointed = true;
+      break;
+    case TW_MT_DATA_ACK:
+      if(twi.state == TWI_READ) {
+        _control |= _BV(TWSTA);
+      }
+      else if(!twi.count) {
+        TWDR = twi.data;
+        twi.count = 1;
+      }
+      else {
+        _control |= _BV(TWSTO);
+        twi.state = TWI_IDLE;
+      }
+      break;
+    case TW_MR_SLA_ACK:
+      _control |= _BV(TWEA);
+      break;
+    case TW_MR_DATA_ACK:
+      burst[!front][twi.count++] = TWDR;
+      if(twi.count < MPU_BURST_SIZE - 1) {
+        _control |= _BV(TWEA);
+      }
+      break;
+    case TW_MR_DATA_NACK:
+      burst[!front][twi.count] = TWDR;
+      front = !front;
+      fresh = true;
+      _control |= _BV(TWSTO);
+      twi.state = TWI_IDLE;
+      break;
+    default:                                    // NACK, lost bus or error.
+      twi.errors++;
+      _control |= _BV(TWSTO);
+      twi.state = TWI_IDLE;
+      break;
+  }
+  TWCR = _control;
+#if SERIAL_SERVO_TIMING
+  isrTicks += TCNT1 - _entry;
+#endif
+}
+
+/**
+ * Starts a bus transaction.
+ *
+ * @param _state TWI_WRITE or TWI_READ.
+ * @param _reg register address.
+ * @param _data value to write.
+ */
+inline void MotionSensor::raw_start(const uint8_t &_state, const uint8_t &_reg,
+                                    const uint8_t &_data) {
+  twi.state = _state;
+  twi.reg = _reg;
+  twi.data = _data;
+  twi.count = 0;
+  twi.pointed = false;
+  twi.start = SerialServo::readClock();
+  TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWINT) | _BV(TWSTA);
+}
+
+/**
+ * Drops the running bus transaction. Disabling the TWI peripheral releases
+ * SDA and SCL, and the error makes sensorRoutine send the setup again.
+ */
+inline void MotionSensor::raw_abort() {
+  cli();
+  if(twi.state != TWI_IDLE) {                   // It may have just ended.
+    TWCR = 0;
+    TWCR = _BV(TWEN);
+    twi.state = TWI_IDLE;
+    twi.errors++;
+    mpu.ready = false;
+  }
+  sei();
+}
+
+/**
+ * Updates the angles with the front burst. The first burst after the setup
+ * takes the accelerometer angles as they are.
+ */
+inline void MotionSensor::raw_filter() {
+#if SERIAL_SERVO_TIMING
+  uint32_t _start = SerialServo::readClock();
+#endif
+  const uint8_t *_burst = burst[front];
+  int16_t _ax = raw_word(_burst, MPU_ACCEL_X);
+  int16_t _ay = raw_word(_burst, MPU_ACCEL_Y);
+  int16_t _az = raw_word(_burst, MPU_ACCEL_Z);
+  int32_t _pitch = int32_t(BodyKinematics::arctan(-int32_t(_ax), _az))
+                   << MPU_FRACT_BITS;
+  int32_t _roll = int32_t(BodyKinematics::arctan(-int32_t(_ay), _az))
+                  << MPU_FRACT_BITS;
+  if(!mpu.ready) {
+    mpu.pitch = _pitch;
+    mpu.roll = _roll;
+    mpu.ready = true;
+  }
+  else {
+    uint32_t _dt = ticksToUs(mpu.lastBurst - mpu.lastSample);
+    if(_dt > MPU_DT_MAX_US) {
+      _dt = MPU_DT_MAX_US;
+    }
+    // The pitch turns around Y and the roll around -X.
+    mpu.pitch += int32_t(raw_word(_burst, MPU_GYRO_Y)) * int32_t(_dt) /
+                 MPU_GYRO_DIV;
+    mpu.roll -= int32_t(raw_word(_burst, MPU_GYRO_X)) * int32_t(_dt) /
+                MPU_GYRO_DIV;
+    mpu.pitch += (_pitch - mpu.pitch) >> MPU_FILTER_SHIFT;
+    mpu.roll += (_roll - mpu.roll) >> MPU_FILTER_SHIFT;
+  }
+  mpu.lastSample = mpu.lastBurst;
+#if SERIAL_SERVO_TIMING
+  uint32_t _ticks = SerialServo::readClock() - _start;
+  timing.samples++;
+  timing.isrTicks += isrTicks;
+  isrTicks = 0;
+  timing.sumTicks += _ticks;
+  if(_ticks > timing.maxTicks) {
+    timing.maxTicks = _ticks;
+  }
+#endif
+}
+
+/**
+ * Reads a big endian value of a burst.
+ *
+ * @param _burst burst.
+ * @param _offset offset of the high byte.
+ * @return value.
+ */
+inline int16_t MotionSensor::raw_word(const uint8_t *_burst,
+                                      const uint8_t &_offset) {
+  return int16_t((uint16_t(_burst[_offset]) << 8) | _burst[_offset + 1]);
+}
+
+// TWI interrupt service routine.
+ISR(TWI_vect) {
+  MotionSensor::TWI_ISR();
+}
@@ -0,0 +1,149 @@
+/**
+ * Part of RoboPrime Firmware.
+ *
+ * MotionSensor.h
+ * Interrupt driven MPU-6050 driver.
+ *
+ * RoboPrime Firmware, (https://github.com/simonepri/RoboPrime)
+ * Copyright (c) 2015, Simone Primarosa, (https://simoneprimarosa.com)
+ *
+ * Licensed under The MIT License
+ * Redistribution of file must retain the above copyright notice.
+ *
+ * @copyright     Copyright (c) 2015, Simone Primarosa, (https://simoneprimarosa.com)
+ * @link          (https://github.com/simonepri/RoboPrime)
+ * @since         0.0.0
+ * @require       SerialServo, BodyKinematics
+ * @license       MIT License (https://opensource.org/licenses/MIT)
+ */
+
+/*
+ * PURPOSE:
+ *
+ * This create a class that reads the MPU-6050 and computes the pitch and the
+ * roll of the trunk, without ever waiting for the I2C bus.
+ * The TWI peripheral is driven by its interrupt: sensorRoutine only starts a
+ * transaction with a TWCR write, then each bus event (start, address, byte)
+ * calls TWI_ISR, which moves the transaction one step further. A burst of the
+ * 14 registers from ACCEL_XOUT_H takes about 370us on the bus at 400kHz, but
+ * only a few us of CPU time.
+ * A transaction that has not ended MPU_TWI_TIMEOUT_US after its start, e.g.
+ * because the sensor holds SDA low, is dropped by sensorRoutine and counts as
+ * a bus error, so the sensor is set up again.
+ * Bursts are read into a double buffer: the ISR fills the back buffer and
+ * swaps it with the front one when the last byte arrives. The next burst is
+ * only started after the front buffer has been used, so it is never written
+ * while it is read.
+ * At every new burst a complementary filter integrates the gyroscope and pulls
+ * the result toward the angle of the gravity measured by the accelerometer,
+ * by 1/2^MPU_FILTER_SHIFT. All the math is fixed point, angles are angle*10 in
+ * Q8 and the accelerometer angles come from BodyKinematics::arctan.
+ * NOTE: that the sensor is expected to be mounted with its X axis forward, its
+ * Y axis to the left and its Z axis up.
+ */
+
+#ifndef _MOTION_SENSOR_H
+#define _MOTION_SENSOR_H
+
+#define MPU_ADDRESS          0x68     // AD0 low.
+#define MPU_TWI_HZ         400000
+#define MPU_TWI_TIMEOUT_US   2000     // About five bursts on the bus.
+#define MPU_RATE_HZ           100     // Default bursts per second.
+#define MPU_RATE_MAX          500
+
+#define MPU_REG_SMPLRT_DIV   0x19
+#define MPU_REG_CONFIG       0x1A
+#define MPU_REG_GYRO_CONFIG  0x1B
+#define MPU_REG_ACCEL_CONFIG 0x1C
+#define MPU_REG_ACCEL_XOUT_H 0x3B
+#define MPU_REG_PWR_MGMT_1   0x6B
+
+// Register writes sent once at startup: wake up on the X gyro clock, 1kHz
+// sample rate, 44Hz low pass filter, +-250deg/s and +-2g full scale.
+#define MPU_SETUP {                                                            \
+  {MPU_REG_PWR_MGMT_1, 0x01}, {MPU_REG_SMPLRT_DIV, 0x00},                      \
+  {MPU_REG_CONFIG, 0x03}, {MPU_REG_GYRO_CONFIG, 0x00},                         \
+  {MPU_REG_ACCEL_CONFIG, 0x00}                                                 \
+}
+#define MPU_SETUP_SIZE          5
+
+// Burst offsets, values are big endian.
+#define MPU_ACCEL_X             0
+#define MPU_ACCEL_Y             2
+#define MPU_ACCEL_Z             4
+#define MPU_GYRO_X              8
+#define MPU_GYRO_Y             10
+#define MPU_BURST_SIZE         14
+
+#define MPU_FRACT_BITS          8     // Angles are angle*10 in Q8.
+#define MPU_GYRO_DIV        51172     // LSB*us for angle*10 in Q8, 131LSB/deg/s.
+#define MPU_FILTER_SHIFT        5     // Accelerometer weight, 1/32.
+#define MPU_DT_MAX_US       50000     // Longest gyro integration.
+
+#define TWI_IDLE                0
+#define TWI_WRITE               1     // One register write.
+#define TWI_READ                2     // Burst read.
+
+struct twi_t {
+  uint8_t state;
+  uint8_t reg, data;
+  uint8_t count;                      // Bytes read by the current burst.
+  bool pointed;                       // Register address sent.
+  uint32_t start;                     // Clock of the transaction start.
+  uint16_t errors;
+};
+
+struct mpu_t {
+  bool ready;                         // First burst filtered.
+  uint8_t setup;                      // Setup writes sent.
+  uint16_t rate;
+  uint32_t lastBurst, lastSample;
+  int32_t pitch, roll;
+  uint16_t errors;                    // Bus errors already handled.
+};
+
+struct mpu_timing_t {
+  uint16_t samples;
+  uint32_t isrTicks;
+  uint32_t sumTicks, maxTicks;
+};
+
+typedef const PROGMEM uint8_t mpu_setup_t;
+
+class MotionSensor {
+  public:
+    static void begin();
+    static void sensorRoutine();
+    static void setRate(uint16_t _rate);
+    static bool isReady();
+    static int16_t getPitch();
+    static int16_t getRoll();
+    static void printAttitude();
+    static void printTiming();
+    static void clearTiming();
+
+    static void TWI_ISR();
+  private:
+    // No-one have to create an istance of this class as we use it as
+    // a singleton, so we keep constructor as private.
+    MotionSensor();
+
+    static void raw_start(const uint8_t &_state, const uint8_t &_reg,
+                          const uint8_t &_data);
+    static void raw_abort();
+    static void raw_filter();
+    static int16_t raw_word(const uint8_t *_burst, const uint8_t &_offset);
+
+    static mpu_setup_t setup[MPU_SETUP_SIZE][2];
+    static volatile twi_t twi;
+    static uint8_t burst[2][MPU_BURST_SIZE];
+    static volatile uint8_t front;
+    static volatile bool fresh;
+    static mpu_t mpu;
+#if SERIAL_SERVO_TIMING
+    static volatile uint16_t isrTicks;
+    static mpu_timing_t timing;
+#endif
+};
+
+#endif
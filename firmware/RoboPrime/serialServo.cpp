@@ -25,6 +25,59 @@
 bool
   SerialServo::sequence;
 
+/**
+ * "overflows" variable is located in SRAM momery and store the number of
+ * Timer1 overflows, it extends TCNT1 to the 32 bit clock, see readClock.
+ */
+volatile uint16_t
+  SerialServo::overflows;
+
+/**
+ * "checkTime" variable is located in SRAM momery and store the clock value at
+ * which the earliest movement deadline expires, see raw_movementCheck.
+ */
+uint32_t
+  SerialServo::checkTime;
+
+/**
+ * "frameStaged" variable is located in SRAM momery and store a bit for each
+ * channel with a width staged for the next frame but not yet committed.
+ */
+uint32_t
+  SerialServo::frameStaged;
+
+/**
+ * "frameSweep", "frameHeld" and "frameGroup" variables are located in SRAM
+ * momery and store a bit for each channel with a sweep staged for the next
+ * frame, respectively not yet committed, committed but not yet started and
+ * started but not yet ended, see raw_frameRelease.
+ */
+uint32_t
+  SerialServo::frameSweep,
+  SerialServo::frameHeld,
+  SerialServo::frameGroup;
+
+/**
+ * "frameClock" variable is located in SRAM momery and store the clock value
+ * the deadlines of the staged sweeps are counted from until they start.
+ */
+uint32_t
+  SerialServo::frameClock;
+
+/**
+ * "frameMask" and "frameCommit" variables are located in SRAM momery and store
+ * the channels committed with commitFrame and if they are waiting for the next
+ * Bank A reset pulse to be released.
+ * "frameLatch" variable is located in SRAM momery and store the Bank B
+ * channels of the frame released by the last Bank A reset pulse, that are
+ * waiting for the next Bank B reset pulse.
+ */
+volatile uint32_t
+  SerialServo::frameMask,
+  SerialServo::frameLatch;
+volatile bool
+  SerialServo::frameCommit;
+
 /**
  * "channel" variable is located in SRAM momery and store the next channel that
  * will be uptated in the Interrupt Routine Service.
@@ -46,6 +99,13 @@ volatile uint16_t
 servo_data_t
   SerialServo::data[SERIAL_SERVO_CHANNELS];
 
+/**
+ * "scale" array is located in SRAM momery and store the angle to pulse ticks
+ * conversion factors of each channel, computed from "bound" at startup.
+ */
+servo_scale_t
+  SerialServo::scale[SERIAL_SERVO_CHANNELS];
+
 /**
  * "bound" array is located in FLASH memory and store information about the maximum
  * and minimum pulse width that can be setted for each channel.
@@ -53,6 +113,16 @@ servo_data_t
 const PROGMEM uint16_t
   SerialServo::bound[SERIAL_SERVO_CHANNELS][BOUND_SIZE] = SERVO_WIDTH_BOUND;
 
+#if SERIAL_SERVO_TIMING
+/**
+ * "timing" array is located in SRAM momery and store the interrupt timing
+ * statistics of each bank. It takes 160 bytes and exists only when
+ * SERIAL_SERVO_TIMING is enabled.
+ */
+volatile servo_timing_t
+  SerialServo::timing[SERIAL_SERVO_BANKS][TIMING_SIZE];
+#endif
+
 /**
  * Initializes class's fields.
  * It programs each pin as an OUTPUT pin.
@@ -64,11 +134,33 @@ void SerialServo::begin() {
     data[_ch].pulseReached = true;
     data[_ch].updateDisabled = true;
     data[_ch].incrementTicks = 0;
-    data[_ch].eachusTicks = 0;
+    data[_ch].rateTicks = 0;
     data[_ch].pulseTicks = 0;
-    data[_ch].lastUpdate = 0;
-    data[_ch].actionTicks = 0;
+    data[_ch].trimTicks = 0;
+    data[_ch].deadlineTicks = 0;
+    data[_ch].profile = SWEEP_LINEAR;
+    data[_ch].profilePos = 0;
+    data[_ch].entrySpeed = data[_ch].exitSpeed = JUNCTION_STOP;
+    data[_ch].sweepTicks = 0;
+
+    uint16_t _range = usToTicks(raw_readMaxWidth(_ch) - raw_readMinWidth(_ch));
+    scale[_ch].degTicks = ((uint32_t(_range) << SCALE_DEG_BITS) +
+                          (MAX_SERVO_ANGLE - MIN_SERVO_ANGLE) / 2) /
+                          (MAX_SERVO_ANGLE - MIN_SERVO_ANGLE);
+    scale[_ch].ticksDeg = ((uint32_t(MAX_SERVO_ANGLE - MIN_SERVO_ANGLE) <<
+                          SCALE_TICKS_BITS) + _range / 2) / _range;
   }
+  clearTiming();
+  frameStaged = 0;
+  frameSweep = 0;
+  frameHeld = 0;
+  frameGroup = 0;
+  frameClock = 0;
+  frameMask = 0;
+  frameLatch = 0;
+  frameCommit = false;
+  overflows = 0;
+  checkTime = 0;
   period[SERIAL_SERVO_BANKA] = 0;
   period[SERIAL_SERVO_BANKB] = 0;
   channel[SERIAL_SERVO_BANKA] = SERIAL_SERVO_BANKA_LOW;
@@ -86,7 +178,13 @@ void SerialServo::begin() {
   digitalWrite(BANKB_RST_PIN,LOW);
 
   TCNT1 = 0;                           // Clear the timer 1 count.
+#if SERIAL_SERVO_HWCLOCK
+  TCCR1A = HWCLOCK_CLEAR;              // Normal counting, OC1A/OC1B clear.
+  TCCR1C = _BV(FOC1A) | _BV(FOC1B);    // Force both clock lines low.
+  TCCR1A = HWCLOCK_SET;                // Set OC1A/OC1B on compare match.
+#else
   TCCR1A = 0;                          // Normal counting mode for Timer1.
+#endif
   TCCR1B = PRESCALER_BITS;             // Set prescaler for Timer1.
 
   // ENABLE TIMER1 OCR1A INTERRUPT to enabled the first bank (A) of 10 servos.
@@ -97,6 +195,10 @@ void SerialServo::begin() {
   TIFR1 |= _BV(OCF1B);                 // Clear any pending interrupts.
   TIMSK1 |=  _BV(OCIE1B);              // Enable the output compare interrupt.
 
+  // ENABLE TIMER1 OVERFLOW INTERRUPT to extend the clock, see readClock.
+  TIFR1 |= _BV(TOV1);                  // Clear any pending interrupts.
+  TIMSK1 |=  _BV(TOIE1);               // Enable the overflow interrupt.
+
   // Start OCR1A interrupt with an initial delay.
   uint16_t _TCNT1 = TCNT1;
   uint16_t _ticks = msToTicks((START_DELAY_MS));
@@ -131,17 +233,16 @@ void SerialServo::writeWidth(uint8_t _ch, uint16_t _us, bool _inverted, bool _ca
   if(!isValidChannel(_ch)) {
     return;
   }
-  if(sequence) {
-    data[_ch].actionTicks -= TCNT1 - data[_ch].lastUpdate;
-  }
-  data[_ch].lastUpdate = TCNT1;
   if(!_calibration) {
     _us = raw_validWidth(_ch, _us);
     if(_inverted) {
       _us = raw_invertWidth(_ch, _us);
     }
   }
-  raw_writeWidth(_ch, _us);
+  else {
+    data[_ch].trimTicks = 0;                    // Sent as it is.
+  }
+  raw_writeTicks(_ch, usToTicks(_us));
 }
 
 /**
@@ -157,16 +258,11 @@ void SerialServo::writeAngle(uint8_t _ch, uint16_t _deg, bool _inverted) {
   if(!isValidChannel(_ch)) {
     return;
   }
-  if(sequence) {
-    data[_ch].actionTicks -= TCNT1 - data[_ch].lastUpdate;
-  }
-  data[_ch].lastUpdate = TCNT1;
   _deg = raw_validAngle(_ch, _deg);
   if(_inverted) {
     _deg = raw_invertAngle(_ch, _deg);
   }
-  _deg = raw_degToUs(_ch, _deg);
-  raw_writeWidth(_ch, _deg);
+  raw_writeTicks(_ch, raw_degToTicks(_ch, _deg));
 }
 
 /**
@@ -198,11 +294,11 @@ uint16_t SerialServo::readAngle(uint8_t _ch, bool _inverted) {
   if(!isValidChannel(_ch)) {
     return (uint16_t)-1.0;
   }
-  uint16_t _us = raw_readWidth(_ch);
+  uint16_t _deg = raw_ticksToDeg(_ch, raw_readTicks(_ch));
   if(_inverted) {
-    _us = raw_invertWidth(_ch, _us);
+    _deg = raw_invertAngle(_ch, _deg);
   }
-  return raw_usToDeg(_ch, _us);
+  return _deg;
 }
 
 /**
@@ -213,22 +309,22 @@ uint16_t SerialServo::readAngle(uint8_t _ch, bool _inverted) {
  * @param _us pulse width to set.
  * @param _time time to sweep.
  * @param _inverted if true it reverses the width passed.
+ * @param _profile velocity profile, see SWEEP_*.
  * @return none.
  */
 void SerialServo::sweepWidth(uint8_t _ch, uint16_t _us, uint16_t _time,
-                             bool _inverted) {
+                             bool _inverted, uint8_t _profile) {
   if(!isValidChannel(_ch)) {
     return;
   }
-  if(sequence) {
-    data[_ch].actionTicks -= TCNT1 - data[_ch].lastUpdate;
+  if(_profile >= SWEEP_SIZE) {
+    _profile = SWEEP_LINEAR;
   }
-  data[_ch].lastUpdate = TCNT1;
   _us = raw_validWidth(_ch, _us);
   if(_inverted) {
     _us = raw_invertWidth(_ch, _us);
   }
-  raw_sweepWidth(_ch, _us, _time);
+  raw_sweepTicks(_ch, usToTicks(_us), _time, _profile);
 }
 
 /**
@@ -239,22 +335,43 @@ void SerialServo::sweepWidth(uint8_t _ch, uint16_t _us, uint16_t _time,
  * @param _deg angle to set.
  * @param _time time to sweep.
  * @param _inverted if true it reverses the width passed.
+ * @param _profile velocity profile, see SWEEP_*.
  */
 void SerialServo::sweepAngle(uint8_t _ch, uint16_t _deg, uint16_t _time,
-                             bool _inverted) {
+                             bool _inverted, uint8_t _profile) {
   if(!isValidChannel(_ch)) {
     return;
   }
-  if(sequence) {
-    data[_ch].actionTicks -= TCNT1 - data[_ch].lastUpdate;
+  if(_profile >= SWEEP_SIZE) {
+    _profile = SWEEP_LINEAR;
   }
-  data[_ch].lastUpdate = TCNT1;
   _deg = raw_validAngle(_ch, _deg);
   if(_inverted) {
     _deg = raw_invertAngle(_ch, _deg);
   }
-  _deg = raw_degToUs(_ch, _deg);
-  raw_sweepWidth(_ch, _deg, _time);
+  raw_sweepTicks(_ch, raw_degToTicks(_ch, _deg), _time, _profile);
+}
+
+/**
+ * Sets the junction speeds of the profiled sweep just started on a channel, so
+ * that it blends with the previous and the next sweep instead of standing
+ * still between them. Speeds are fractions of the average speed of the sweep,
+ * see JUNCTION_FULL. Linear sweeps already keep their speed and are left as
+ * they are.
+ *
+ * @param _ch channel index.
+ * @param _entry speed at the start of the sweep.
+ * @param _exit speed at the end of the sweep.
+ */
+void SerialServo::blendSweep(uint8_t _ch, uint8_t _entry, uint8_t _exit) {
+  if(!isValidChannel(_ch)) {
+    return;
+  }
+  if(data[_ch].profile == SWEEP_LINEAR) {
+    return;
+  }
+  data[_ch].entrySpeed = _entry;
+  data[_ch].exitSpeed = _exit;
 }
 
 /**
@@ -268,10 +385,6 @@ void SerialServo::wait(uint8_t _ch, uint16_t _time) {
   if(!isValidChannel(_ch)) {
     return;
   }
-  if(sequence) {
-    data[_ch].actionTicks -= TCNT1 - data[_ch].lastUpdate;
-  }
-  data[_ch].lastUpdate = TCNT1;
   raw_wait(_ch, _time);
 }
 
@@ -319,16 +432,276 @@ bool SerialServo::isMoving(uint8_t _ch) {
   if(!isValidChannel(_ch)) {
     return false;
   }
-  return (data[_ch].actionTicks > 0);
+  return int32_t(data[_ch].deadlineTicks - raw_readClock()) > 0;
+}
+
+/**
+ * Trims a channel by an angle, added to every pulse on top of the width and of
+ * the sweep of the channel until it is trimmed again. The trimmed pulse is
+ * kept within the channel bounds, now and for the widths and sweeps set
+ * later, so less than the angle may be added. A channel whose width was never
+ * set is not trimmed.
+ *
+ * @param _ch channel index.
+ * @param _deg angle*10 to add, 0 to remove the trim.
+ * @param _inverted if true it reverses the angle passed.
+ */
+void SerialServo::trimAngle(uint8_t _ch, int16_t _deg, bool _inverted) {
+  if(!isValidChannel(_ch)) {
+    return;
+  }
+  int16_t _ticks = (int32_t(_deg) * scale[_ch].degTicks) >> SCALE_DEG_BITS;
+  if(_inverted) {
+    _ticks = -_ticks;
+  }
+  raw_trimTicks(_ch, _ticks);
+}
+
+/**
+ * Stages a pulse width for a channel. The channel keeps its actual width
+ * until commitFrame is called, see commitFrame.
+ *
+ * @param _ch channel index.
+ * @param _us pulse width to set.
+ * @param _inverted if true it reverses the width passed.
+ */
+void SerialServo::stageWidth(uint8_t _ch, uint16_t _us, bool _inverted) {
+  if(!isValidChannel(_ch)) {
+    return;
+  }
+  _us = raw_validWidth(_ch, _us);
+  if(_inverted) {
+    _us = raw_invertWidth(_ch, _us);
+  }
+  raw_stageTicks(_ch, usToTicks(_us));
+}
+
+/**
+ * Stages an angle for a channel. The channel keeps its actual angle
+ * until commitFrame is called, see commitFrame.
+ *
+ * @param _ch channel index.
+ * @param _deg angle to set.
+ * @param _inverted if true it reverses the width passed.
+ */
+void SerialServo::stageAngle(uint8_t _ch, uint16_t _deg, bool _inverted) {
+  if(!isValidChannel(_ch)) {
+    return;
+  }
+  _deg = raw_validAngle(_ch, _deg);
+  if(_inverted) {
+    _deg = raw_invertAngle(_ch, _deg);
+  }
+  raw_stageTicks(_ch, raw_degToTicks(_ch, _deg));
+}
+
+/**
+ * Stages a sweep to a pulse width for a channel. The channel keeps its actual
+ * width until commitFrame is called, then all the sweeps staged together start
+ * on the same frame and end on the same frame, see commitFrame.
+ *
+ * @param _ch channel index.
+ * @param _us pulse width to set.
+ * @param _time time to sweep.
+ * @param _inverted if true it reverses the width passed.
+ * @param _profile velocity profile, see SWEEP_*.
+ */
+void SerialServo::stageSweepWidth(uint8_t _ch, uint16_t _us, uint16_t _time,
+                                  bool _inverted, uint8_t _profile) {
+  if(!isValidChannel(_ch)) {
+    return;
+  }
+  if(_profile >= SWEEP_SIZE) {
+    _profile = SWEEP_LINEAR;
+  }
+  _us = raw_validWidth(_ch, _us);
+  if(_inverted) {
+    _us = raw_invertWidth(_ch, _us);
+  }
+  raw_stageSweep(_ch, usToTicks(_us), _time, _profile);
+}
+
+/**
+ * Stages a sweep to an angle for a channel. The channel keeps its actual
+ * angle until commitFrame is called, see stageSweepWidth.
+ *
+ * @param _ch channel index.
+ * @param _deg angle to set.
+ * @param _time time to sweep.
+ * @param _inverted if true it reverses the width passed.
+ * @param _profile velocity profile, see SWEEP_*.
+ */
+void SerialServo::stageSweepAngle(uint8_t _ch, uint16_t _deg, uint16_t _time,
+                                  bool _inverted, uint8_t _profile) {
+  if(!isValidChannel(_ch)) {
+    return;
+  }
+  if(_profile >= SWEEP_SIZE) {
+    _profile = SWEEP_LINEAR;
+  }
+  _deg = raw_validAngle(_ch, _deg);
+  if(_inverted) {
+    _deg = raw_invertAngle(_ch, _deg);
+  }
+  raw_stageSweep(_ch, raw_degToTicks(_ch, _deg), _time, _profile);
+}
+
+/**
+ * Commits all the staged channels as a single frame.
+ * They are released at the next Bank A reset pulse, the Bank B ones being
+ * latched until the next Bank B reset pulse, so each bank outputs all of its
+ * new widths within a single frame of its own.
+ * Staged sweeps start from that frame, see raw_frameRelease.
+ * Staging and committing again before the release merges the two frames.
+ */
+void SerialServo::commitFrame() {
+  if(!frameStaged) {
+    return;
+  }
+  cli();
+  frameMask |= frameStaged;
+  frameCommit = true;
+  sei();
+  frameHeld |= frameSweep;
+  frameSweep = 0;
+  frameStaged = 0;
+}
+
+/**
+ * Checks if a committed frame is still waiting for the next Bank A reset, or
+ * for the next Bank B reset for its Bank B channels.
+ *
+ * @return true if the frame has not been released yet, false otherwise.
+ */
+bool SerialServo::isFramePending() {
+  return frameCommit || frameLatch;
+}
+
+/**
+ * Prints the interrupt timing statistics, one line for each bank and type:
+ * <bank[A-B]> <type[L-D-P-C]> <min> <max> <bucket 0> ... <bucket 7>
+ * L is the latency from the compare match to the ISR entry and D the ISR
+ * duration, both in CPU cycles. P is the frame period and C the delay from
+ * the deadline of a movement to its completion, both in microseconds.
+ * Buckets are counts, see TIMING_*_BASE and TIMING_*_SHIFT for their bounds.
+ * Nothing is printed unless SERIAL_SERVO_TIMING is enabled.
+ */
+void SerialServo::printTiming() {
+#if SERIAL_SERVO_TIMING
+  servo_timing_t _timing;
+  for(uint8_t _block = 0; _block < SERIAL_SERVO_BANKS; _block++) {
+    for(uint8_t _type = 0; _type < TIMING_SIZE; _type++) {
+      cli();
+      _timing.minTicks = timing[_block][_type].minTicks;
+      _timing.maxTicks = timing[_block][_type].maxTicks;
+      for(uint8_t _i = 0; _i < TIMING_BUCKETS; _i++) {
+        _timing.bucket[_i] = timing[_block][_type].bucket[_i];
+      }
+      sei();
+      if(_timing.minTicks > _timing.maxTicks) {
+        _timing.minTicks = _timing.maxTicks;
+      }
+      Serial.print(char('A' + _block));
+      Serial.print(' ');
+      Serial.print("LDPC"[_type]);
+      if(_type >= TIMING_PERIOD) {
+        Serial.print(' ');
+        Serial.print(ticksToUs(uint32_t(_timing.minTicks)));
+        Serial.print(' ');
+        Serial.print(ticksToUs(uint32_t(_timing.maxTicks)));
+      }
+      else {
+        Serial.print(' ');
+        Serial.print(uint32_t(_timing.minTicks) * PRESCALER_VALUE);
+        Serial.print(' ');
+        Serial.print(uint32_t(_timing.maxTicks) * PRESCALER_VALUE);
+      }
+      for(uint8_t _i = 0; _i < TIMING_BUCKETS; _i++) {
+        Serial.print(' ');
+        Serial.print(_timing.bucket[_i]);
+      }
+      Serial.println();
+    }
+  }
+#endif
+}
+
+/**
+ * Clears the interrupt timing statistics.
+ */
+void SerialServo::clearTiming() {
+#if SERIAL_SERVO_TIMING
+  for(uint8_t _block = 0; _block < SERIAL_SERVO_BANKS; _block++) {
+    for(uint8_t _type = 0; _type < TIMING_SIZE; _type++) {
+      cli();
+      timing[_block][_type].minTicks = 0xFFFF;
+      timing[_block][_type].maxTicks = 0;
+      for(uint8_t _i = 0; _i < TIMING_BUCKETS; _i++) {
+        timing[_block][_type].bucket[_i] = 0;
+      }
+      sei();
+    }
+  }
+#endif
+}
+
+/**
+ * Reads the 32 bit clock, that is TCNT1 extended by the overflow count.
+ * It counts timer ticks (2 per us) and wraps every ~36 minutes.
+ *
+ * @return clock ticks.
+ */
+uint32_t SerialServo::readClock() {
+  return raw_readClock();
+}
+
+/**
+ * Reads the clock value at which the movement of a channel ends, the channel is
+ * moving until readClock reaches it, see isMoving.
+ *
+ * @param _ch channel index.
+ * @return clock ticks.
+ */
+uint32_t SerialServo::readDeadline(uint8_t _ch) {
+  if(!isValidChannel(_ch)) {
+    return 0;
+  }
+  return data[_ch].deadlineTicks;
 }
 
 /**
  * Enable sequence time compensation for sweep movments.
+ * Channels that are not moving start the sequence from now, so the time they
+ * spent idle is not compensated.
  */
 void SerialServo::enableSequence() {
+  if(sequence) {
+    return;
+  }
+  uint32_t _now = raw_readClock();
+  for(uint8_t _ch = 0; _ch < SERIAL_SERVO_CHANNELS; _ch++) {
+    if(int32_t(data[_ch].deadlineTicks - _now) < 0) {
+      data[_ch].deadlineTicks = _now;
+    }
+  }
   sequence = true;
 }
 
+/**
+ * Sets the clock value the next sequence movement of a channel starts from,
+ * instead of the end of the previous one. Does nothing unless sequence is
+ * enabled.
+ *
+ * @param _ch channel index.
+ * @param _start clock ticks, not after now.
+ */
+void SerialServo::setSequenceStart(uint8_t _ch, uint32_t _start) {
+  if(!isValidChannel(_ch) || !sequence) {
+    return;
+  }
+  data[_ch].deadlineTicks = _start;
+}
+
 /**
  * Disable sequence time compensation for sweep movments.
  */
@@ -337,34 +710,39 @@ void SerialServo::disableSequence() {
 }
  
 /**
- * Converts deg to us.
+ * Converts deg to pulse ticks.
  *
  * @param _ch channel index.
  * @param _deg angle to set.
- * @return microseconds.
+ * @return pulse ticks.
  */
-inline uint16_t SerialServo::raw_degToUs(const uint8_t &_ch,
-                                         const uint16_t &_deg) {
-  return (_deg - MIN_SERVO_ANGLE) *
-         (float(raw_readMaxWidth(_ch) - raw_readMinWidth(_ch)) /
-         (MAX_SERVO_ANGLE - MIN_SERVO_ANGLE)) +
-         raw_readMinWidth(_ch);
+inline uint16_t SerialServo::raw_degToTicks(const uint8_t &_ch,
+                                            const uint16_t &_deg) {
+  return ((uint32_t(_deg - MIN_SERVO_ANGLE) * scale[_ch].degTicks +
+         _BV(SCALE_DEG_BITS - 1)) >> SCALE_DEG_BITS) +
+         usToTicks(raw_readMinWidth(_ch));
 }
 
 /**
- * Convert us to deg.
+ * Converts pulse ticks to deg.
  *
  * @param _ch channel index.
- * @param _us pulse width to set.
+ * @param _ticks pulse ticks.
  * @return angle.
  */
-inline uint16_t SerialServo::raw_usToDeg(const uint8_t &_ch,
-                                         const uint16_t &_us) {
-  uint8_t _readus = raw_readMinWidth(_ch);
-  return (_us - _readus) *
-         (float(MAX_SERVO_ANGLE - MIN_SERVO_ANGLE) /
-         (raw_readMaxWidth(_ch) - _readus)) +
-         MIN_SERVO_ANGLE;
+inline uint16_t SerialServo::raw_ticksToDeg(const uint8_t &_ch,
+                                            const uint16_t &_ticks) {
+  uint16_t _min = usToTicks(raw_readMinWidth(_ch));
+  if(_ticks <= _min) {
+    return MIN_SERVO_ANGLE;
+  }
+  uint16_t _deg = ((uint32_t(_ticks - _min) * scale[_ch].ticksDeg +
+                  (1UL << (SCALE_TICKS_BITS - 1))) >> SCALE_TICKS_BITS) +
+                  MIN_SERVO_ANGLE;
+  if(_deg > MAX_SERVO_ANGLE) {
+    return MAX_SERVO_ANGLE;
+  }
+  return _deg;
 }
 
 /**
@@ -376,7 +754,7 @@ inline uint16_t SerialServo::raw_usToDeg(const uint8_t &_ch,
  */
 inline uint16_t SerialServo::raw_validWidth(const uint8_t &_ch,
                                             const uint16_t &_us) {
-  uint8_t _readus = raw_readMinWidth(_ch);
+  uint16_t _readus = raw_readMinWidth(_ch);
   if(_us < _readus) {
     return _readus;
   }
@@ -433,20 +811,22 @@ inline uint16_t SerialServo::raw_invertAngle(const uint8_t &_ch,
  * See writeWidth
  *
  * @param _ch channel index.
- * @param _us pulse width to set.
+ * @param _ticks pulse ticks to set.
  * @return none.
  */
-inline void SerialServo::raw_writeWidth(const uint8_t &_ch,
-                                        const uint16_t &_us) {
+inline void SerialServo::raw_writeTicks(const uint8_t &_ch,
+                                        const uint16_t &_ticks) {
   data[_ch].updateDisabled = true;
+  raw_frameDrop(_ch);
   uint16_t _width = data[_ch].pulseTicks;
   data[_ch].incrementTicks = 0;
 
-  data[_ch].actionTicks = 0;
-  data[_ch].eachusTicks = 0;
-  data[_ch].deltaTicks = usToTicks(_us) - _width; // Save the wanted pulse width.
+  data[_ch].deadlineTicks = raw_readClock();
+  data[_ch].rateTicks = 0;
+  data[_ch].deltaTicks = raw_trimmedTicks(_ch, _ticks) - _width;
   
   data[_ch].pulseReached = false;       // Set the pulse width as not reached.
+  raw_scheduleCheck(_ch);
 }
 
 /**
@@ -456,7 +836,17 @@ inline void SerialServo::raw_writeWidth(const uint8_t &_ch,
  * @return channel pulse width.
  */
 inline uint16_t SerialServo::raw_readWidth(const uint8_t &_ch) {
-  return data[_ch].pulseTicks;
+  return ticksToUs(raw_readTicks(_ch));
+}
+
+/**
+ * Reads the pulse ticks of a channel, without its trim.
+ *
+ * @param _ch channel index.
+ * @return channel pulse ticks.
+ */
+inline uint16_t SerialServo::raw_readTicks(const uint8_t &_ch) {
+  return data[_ch].pulseTicks - data[_ch].trimTicks;
 }
 
 //static uint32_t start[20];
@@ -465,34 +855,71 @@ inline uint16_t SerialServo::raw_readWidth(const uint8_t &_ch) {
  * See sweepWidth
  *
  * @param _ch channel index.
- * @param _us pulse width to set.
+ * @param _ticks pulse ticks to set.
  * @param _time time to sweep.
+ * @param _profile velocity profile, see SWEEP_*.
  */
-inline void SerialServo::raw_sweepWidth(const uint8_t &_ch, const uint16_t &_us,
-                                        const uint16_t &_time) {
+inline void SerialServo::raw_sweepTicks(const uint8_t &_ch, const uint16_t &_ticks,
+                                        const uint16_t &_time,
+                                        const uint8_t &_profile) {
   data[_ch].updateDisabled = true;
-  uint16_t _width = data[_ch].pulseTicks;
+  raw_frameDrop(_ch);
   
+  uint32_t _now = raw_readClock();
   if(sequence) {
-    data[_ch].actionTicks = msToTicks(_time) + data[_ch].actionTicks;
+    data[_ch].deadlineTicks += msToTicks(_time);
   }
   else {
-    data[_ch].actionTicks = msToTicks(_time);
+    data[_ch].deadlineTicks = _now + msToTicks(_time);
   }
   
-  data[_ch].incrementTicks = 0;
-  int16_t _delta_ticks = usToTicks(_us) - _width;
-  float _us_ticks = data[_ch].actionTicks / float(_delta_ticks);
-  data[_ch].eachusTicks = _us_ticks;
-  data[_ch].deltaTicks = _delta_ticks;        // Save the wanted pulse width.
+  raw_sweepStart(_ch, _ticks, data[_ch].deadlineTicks - _now, _profile);
   
   data[_ch].pulseReached = false;       // Set the pulse width as not reached.
+  raw_scheduleCheck(_ch);
   
   //Serial.println(' ');
   //Serial.println(_time);
   //start[_ch] = millis();
 }
 
+/**
+ * Loads the rate and the profile of a sweep from the actual pulse width.
+ *
+ * @param _ch channel index.
+ * @param _ticks pulse ticks to reach.
+ * @param _time timer ticks to sweep.
+ * @param _profile velocity profile, see SWEEP_*.
+ */
+inline void SerialServo::raw_sweepStart(const uint8_t &_ch,
+                                        const uint16_t &_ticks,
+                                        const int32_t &_time,
+                                        const uint8_t &_profile) {
+  data[_ch].incrementTicks = 0;
+  int16_t _delta_ticks = raw_trimmedTicks(_ch, _ticks) - data[_ch].pulseTicks;
+  data[_ch].profile = _profile;
+  if(_profile == SWEEP_LINEAR) {
+    data[_ch].rateTicks = raw_sweepRate(_delta_ticks, _time);
+#if SERIAL_SERVO_FLOAT_SWEEP
+    // Clamped as raw_sweepRate does.
+    float _max = float(RATE_MAX) / (1UL << RATE_FRACT_BITS);
+    float _rate = _time > 0 ? float(_delta_ticks) / _time : _max;
+    if(_rate > _max || _rate < -_max) {
+      _rate = _delta_ticks < 0 ? -_max : _max;
+    }
+    data[_ch].rateFloat = _rate;
+#endif
+  }
+  else {
+    // The rate advances the phase, a whole sweep is 1.0.
+    data[_ch].rateTicks = raw_sweepRate(1, _time);
+    data[_ch].profilePos = 0;
+    data[_ch].sweepTicks = _delta_ticks;
+    data[_ch].entrySpeed = data[_ch].exitSpeed = JUNCTION_STOP;
+  }
+  data[_ch].deltaTicks = _delta_ticks;        // Save the wanted pulse width.
+}
+
 /**
  * See wait
  *
@@ -501,21 +928,256 @@ inline void SerialServo::raw_sweepWidth(const uint8_t &_ch, const uint16_t &_us,
  */
 inline void SerialServo::raw_wait(const uint8_t &_ch, const uint16_t &_time) {
   data[_ch].updateDisabled = true;
+  raw_frameDrop(_ch);
   
   if(sequence) {
-    data[_ch].actionTicks = msToTicks(_time) + data[_ch].actionTicks;
+    data[_ch].deadlineTicks += msToTicks(_time);
   }
   else {
-    data[_ch].actionTicks = msToTicks(_time);
+    data[_ch].deadlineTicks = raw_readClock() + msToTicks(_time);
   }
   
-  data[_ch].eachusTicks = 0;
+  data[_ch].rateTicks = 0;
   data[_ch].deltaTicks = 0;
   data[_ch].incrementTicks = 0;
   
   data[_ch].pulseReached = false;       // Set the pulse width as not reached.
+  raw_scheduleCheck(_ch);
 }
 
+/**
+ * See trimAngle.
+ * The change of the trim is added to the pending increment and to the width
+ * to reach, as raw_stageTicks does, with the updates disabled meanwhile. It is
+ * limited so that neither the pulse nor the width to reach leave the channel
+ * bounds. The updates are enabled again, so the next pulse takes it, unless
+ * the channel is held by a staged frame or group, which releases it.
+ *
+ * @param _ch channel index.
+ * @param _ticks pulse ticks to add.
+ */
+inline void SerialServo::raw_trimTicks(const uint8_t &_ch, int16_t _ticks) {
+  int16_t _diff = _ticks - data[_ch].trimTicks;
+  if(!_diff) {
+    return;
+  }
+  bool _disabled = data[_ch].updateDisabled;
+  data[_ch].updateDisabled = true;
+  int16_t _pulse = data[_ch].pulseTicks;
+  int16_t _target = _pulse + data[_ch].deltaTicks;
+  if(_target) {
+    int16_t _min = usToTicks(raw_readMinWidth(_ch)) -
+                   (_pulse < _target ? _pulse : _target);
+    int16_t _max = usToTicks(raw_readMaxWidth(_ch)) -
+                   (_pulse < _target ? _target : _pulse);
+    if(_diff > _max) {
+      _diff = _max;
+    }
+    else if(_diff < _min) {
+      _diff = _min;
+    }
+    data[_ch].incrementTicks += int32_t(_diff) << INCREMENT_FRACT_BITS;
+    data[_ch].deltaTicks += _diff;
+    data[_ch].trimTicks += _diff;
+  }
+  uint32_t _bit = 1UL << _ch;
+  cli();
+  uint32_t _held = frameMask | frameLatch;
+  sei();
+  _held |= frameStaged | frameSweep | frameHeld | frameGroup;
+  if(!_disabled || !(_held & _bit)) {
+    data[_ch].updateDisabled = false;
+  }
+}
+
+/**
+ * Adds the trim of a channel to a width to reach, within the channel bounds.
+ * The trim keeps only the part actually added, so raw_readTicks gives back
+ * the width once it is reached.
+ *
+ * @param _ch channel index.
+ * @param _ticks pulse ticks to reach, without the trim.
+ * @return pulse ticks to reach.
+ */
+inline uint16_t SerialServo::raw_trimmedTicks(const uint8_t &_ch,
+                                              const uint16_t &_ticks) {
+  if(!data[_ch].trimTicks) {
+    return _ticks;
+  }
+  uint16_t _min = usToTicks(raw_readMinWidth(_ch));
+  uint16_t _max = usToTicks(raw_readMaxWidth(_ch));
+  uint16_t _trimmed = _ticks + data[_ch].trimTicks;
+  if(int16_t(_trimmed) < int16_t(_min)) {
+    _trimmed = _min;
+  }
+  else if(_trimmed > _max) {
+    _trimmed = _max;
+  }
+  data[_ch].trimTicks = _trimmed - _ticks;
+  return _trimmed;
+}
+
+
+/**
+ * See stageWidth.
+ * The whole change is loaded as the pending increment with updates disabled,
+ * and the channel is marked as reached so that raw_movementCheck will not
+ * release it before raw_frameCommit does.
+ *
+ * @param _ch channel index.
+ * @param _ticks pulse ticks to set.
+ */
+inline void SerialServo::raw_stageTicks(const uint8_t &_ch,
+                                        const uint16_t &_ticks) {
+  data[_ch].updateDisabled = true;
+  raw_frameDrop(_ch);
+  int16_t _delta_ticks = raw_trimmedTicks(_ch, _ticks) - data[_ch].pulseTicks;
+
+  data[_ch].deadlineTicks = raw_readClock();
+  data[_ch].rateTicks = 0;
+  data[_ch].deltaTicks = _delta_ticks;        // Save the wanted pulse width.
+  data[_ch].incrementTicks = int32_t(_delta_ticks) << INCREMENT_FRACT_BITS;
+
+  data[_ch].pulseReached = true;
+  frameStaged |= 1UL << _ch;
+}
+
+/**
+ * See stageSweepWidth.
+ * The deadline is counted from frameClock, that is taken once when nothing is
+ * staged nor held, so every sweep staged together gets the same deadline.
+ * The channel is marked as reached so that neither raw_incrementCalculator
+ * nor raw_movementCheck touch it before raw_frameRelease starts it.
+ *
+ * @param _ch channel index.
+ * @param _ticks pulse ticks to reach.
+ * @param _time time to sweep.
+ * @param _profile velocity profile, see SWEEP_*.
+ */
+inline void SerialServo::raw_stageSweep(const uint8_t &_ch,
+                                        const uint16_t &_ticks,
+                                        const uint16_t &_time,
+                                        const uint8_t &_profile) {
+  data[_ch].updateDisabled = true;
+  raw_frameDrop(_ch);
+  if(!frameStaged && !frameHeld) {
+    frameClock = raw_readClock();
+  }
+
+  int32_t _sweep = msToTicks(_time);
+  data[_ch].deadlineTicks = frameClock + _sweep;
+  raw_sweepStart(_ch, _ticks, _sweep, _profile);
+
+  data[_ch].pulseReached = true;
+  frameStaged |= 1UL << _ch;
+  frameSweep |= 1UL << _ch;
+}
+
+/**
+ * Brings the next raw_movementCheck forward to the deadline of a channel if it
+ * expires before the one already scheduled. A deadline already expired is
+ * checked from now.
+ *
+ * @param _ch channel index.
+ */
+inline void SerialServo::raw_scheduleCheck(const uint8_t &_ch) {
+  uint32_t _due = raw_readClock();
+  if(int32_t(data[_ch].deadlineTicks - _due) > 0) {
+    _due = data[_ch].deadlineTicks;
+  }
+  if(int32_t(_due - checkTime) < 0) {
+    checkTime = _due;
+  }
+}
+
+/**
+ * Releases the Bank A channels of the committed frame and latches the Bank B
+ * ones, see raw_frameLatch. It's called by the Bank A interrupt once per frame
+ * just before the reset pulse, so no work is added for other channels.
+ */
+inline void SerialServo::raw_frameCommit() {
+  if(!frameCommit) {
+    return;
+  }
+  uint32_t _mask = frameMask & ~SERIAL_SERVO_BANKB_MASK;
+  for(uint8_t _ch = SERIAL_SERVO_BANKA_LOW; _mask; _ch++, _mask >>= 1) {
+    if(_mask & 1) {
+      data[_ch].updateDisabled = false;
+    }
+  }
+  cli();                                        // Bank B may be running.
+  frameLatch |= frameMask & SERIAL_SERVO_BANKB_MASK;
+  sei();
+  frameMask = 0;
+  frameCommit = false;
+}
+
+/**
+ * Releases the Bank B channels latched by raw_frameCommit. It's called by the
+ * Bank B interrupt once per frame just before the reset pulse, so a frame is
+ * never split inside Bank B either.
+ */
+inline void SerialServo::raw_frameLatch() {
+  cli();                                        // Bank A may be running.
+  uint32_t _mask = frameLatch >> SERIAL_SERVO_BANKB_LOW;
+  frameLatch = 0;
+  sei();
+  for(uint8_t _ch = SERIAL_SERVO_BANKB_LOW; _mask; _ch++, _mask >>= 1) {
+    if(_mask & 1) {
+      data[_ch].updateDisabled = false;
+    }
+  }
+}
+
+/**
+ * Starts the sweeps held by the frame just released. It's called by
+ * servoRoutine, so the deadlines are moved from frameClock to the actual
+ * clock outside of the interrupt and keep being equal to each other.
+ */
+inline void SerialServo::raw_frameRelease() {
+  uint32_t _shift = raw_readClock() - frameClock;
+  uint32_t _mask = frameHeld;
+  for(uint8_t _ch = 0; _mask; _ch++, _mask >>= 1) {
+    if(_mask & 1) {
+      data[_ch].deadlineTicks += _shift;
+      data[_ch].pulseReached = false;
+      raw_scheduleCheck(_ch);
+    }
+  }
+  frameGroup |= frameHeld;
+  frameHeld = 0;
+}
+
+/**
+ * Checks if the pending increment of a started staged sweep would make it
+ * reach its width. Such an increment is held until the deadline of the sweep,
+ * so that none of the sweeps staged together ends on an earlier frame than the
+ * others, see raw_channelCheck.
+ *
+ * @param _ch channel index.
+ * @return true if the increment has to be held, false otherwise.
+ */
+inline bool SerialServo::raw_frameArrives(const uint8_t &_ch) {
+  if(!(frameGroup & (1UL << _ch))) {
+    return false;
+  }
+  int16_t _increment = data[_ch].incrementTicks >> INCREMENT_FRACT_BITS;
+  int16_t _delta = data[_ch].deltaTicks;
+  return _delta < 0 ? _increment <= _delta : _increment >= _delta;
+}
+
+/**
+ * Removes a channel from the staged, held and started sweeps, as it has just
+ * been given a new movement.
+ *
+ * @param _ch channel index.
+ */
+inline void SerialServo::raw_frameDrop(const uint8_t &_ch) {
+  uint32_t _keep = ~(1UL << _ch);
+  frameSweep &= _keep;
+  frameHeld &= _keep;
+  frameGroup &= _keep;
+}
 
 /**
  * See readMinWidth.
@@ -538,34 +1200,312 @@ inline uint16_t SerialServo::raw_readMaxWidth(const uint8_t &_ch) {
 }
 
 /**
- * Checks if is elapsed enought time to set the movment as completed.
+ * Computes the sweep rate as the Q0.31 number of pulse ticks to add for each
+ * elapsed timer tick. The division is done bit by bit on integers, so it costs
+ * a fixed 31 iterations of shift and subtract.
+ * Rates above RATE_MAX are clamped, such sweeps complete within one frame.
+ *
+ * @param _delta pulse ticks to travel.
+ * @param _time timer ticks available for the sweep.
+ * @return signed sweep rate.
+ */
+inline int32_t SerialServo::raw_sweepRate(const int16_t &_delta,
+                                          const int32_t &_time) {
+  uint32_t _remainder = (_delta < 0) ? -_delta : _delta;
+  uint32_t _rate = RATE_MAX;
+  if(_time > 0 && (_remainder << 2) < uint32_t(_time)) {
+    _rate = 0;
+    for(uint8_t _bit = 0; _bit < RATE_FRACT_BITS; _bit++) {
+      _remainder <<= 1;
+      _rate <<= 1;
+      if(_remainder >= uint32_t(_time)) {
+        _remainder -= _time;
+        _rate |= 1;
+      }
+    }
+  }
+  if(_delta < 0) {
+    return -int32_t(_rate);
+  }
+  return _rate;
+}
+
+/**
+ * Computes the Q16.16 pulse increment for a period at a given sweep rate.
+ * The 32x16 bit product is split into two 16x16 bit hardware multiplications.
+ *
+ * @param _rate sweep rate, see raw_sweepRate.
+ * @param _period elapsed timer ticks.
+ * @return pulse ticks increment.
+ */
+inline int32_t SerialServo::raw_rateIncrement(const int32_t &_rate,
+                                              const uint16_t &_period) {
+  int16_t _high = _rate >> 16;
+  uint16_t _low = _rate;
+  return ((int32_t(_high) * _period) << 1) +
+         ((uint32_t(_low) * _period) >> (RATE_FRACT_BITS - INCREMENT_FRACT_BITS));
+}
+
+/**
+ * Computes the phase of a profiled sweep from the timer ticks left to its
+ * deadline, so that only the phase rate is stored. The phase is PHASE_END less
+ * the product of the rate and the ticks left, as both are below 2^31 at most
+ * two 16x16 bit multiplications are needed besides the low words one.
+ *
+ * @param _rate phase rate, see raw_sweepRate.
+ * @param _left timer ticks left to the deadline.
+ * @return Q0.31 sweep phase, 0 if the sweep has still to start.
+ */
+inline uint32_t SerialServo::raw_sweepPhase(const int32_t &_rate,
+                                            const int32_t &_left) {
+  if(_left <= 0) {
+    return PHASE_END;
+  }
+  uint16_t _left_high = uint32_t(_left) >> 16;
+  uint16_t _rate_high = uint32_t(_rate) >> 16;
+  if(_left_high && _rate_high) {
+    return 0;
+  }
+  uint32_t _high = uint32_t(_left_high) * uint16_t(_rate) +
+                   uint32_t(_rate_high) * uint16_t(_left);
+  if(_high >= (PHASE_END >> 16)) {
+    return 0;
+  }
+  uint32_t _low = uint32_t(uint16_t(_left)) * uint16_t(_rate);
+  uint32_t _done = (_high << 16) + _low;
+  if(_done < _low || _done >= PHASE_END) {
+    return 0;
+  }
+  return PHASE_END - _done;
+}
+
+/**
+ * Computes the position along a sweep profile.
+ * The trapezoid goes from the entry speed a to the cruise speed
+ * c = 4/3 - (a + b) / 6 on the first quarter of the time and from c to the exit
+ * speed b on the last quarter, so that it still covers the whole sweep. The
+ * S-curve is the minimum jerk polynomial 10u^3 - 15u^4 + 6u^5 plus the quintic
+ * Hermite terms a u (1 - u)^3 (1 + 3u) - b u^3 (1 - u) (4 - 3u). Both reduce to
+ * the plain profile when a = b = 0 and to the linear sweep when a = b = 1.
+ *
+ * @param _profile velocity profile, see SWEEP_*.
+ * @param _phase Q0.31 sweep phase.
+ * @param _entry Q0.16 entry speed.
+ * @param _exit Q0.16 exit speed.
+ * @return Q0.16 fraction of the sweep, saturated at 0xFFFF.
+ */
+inline uint16_t SerialServo::raw_profilePos(const uint8_t &_profile,
+                                            const uint32_t &_phase,
+                                            const uint16_t &_entry,
+                                            const uint16_t &_exit) {
+  if(_phase >= PHASE_END) {
+    return 0xFFFF;
+  }
+  uint16_t _u = _phase >> (PHASE_FRACT_BITS - 16);
+  if(_u == 0) {
+    return 0;
+  }
+  int32_t _s;
+  if(_profile == SWEEP_TRAPEZOID) {
+    uint32_t _cruise = PROFILE_CRUISE -
+                       (((uint32_t(_entry) + _exit) * PROFILE_SIXTH) >> 16);
+    if(_u < PROFILE_QUARTER) {
+      uint32_t _u2 = (uint32_t(_u) * _u) >> 16;
+      _s = ((uint32_t(_entry) * _u) >> 16) +
+           (((_cruise - _entry) * _u2) >> 15);
+    }
+    else if(_u <= 3 * PROFILE_QUARTER) {
+      _s = ((_entry + _cruise) >> 3) +
+           ((_cruise * (_u - PROFILE_QUARTER)) >> 16);
+    }
+    else {
+      uint32_t _v = 0x10000UL - _u;
+      uint32_t _v2 = (_v * _v) >> 16;
+      _s = 0x10000L - (((_exit * _v) >> 16) + (((_cruise - _exit) * _v2) >> 15));
+    }
+  }
+  else {
+    uint32_t _v = 0x10000UL - _u;
+    uint32_t _u2 = (uint32_t(_u) * _u) >> 16;
+    uint32_t _u3 = (_u2 * _u) >> 16;
+    uint32_t _poly = 40960 + ((_u2 * 6) >> 4) - ((uint32_t(_u) * 15) >> 4);
+    _s = (_u3 * _poly) >> 12;                   // _poly is Q4.12.
+    if(_entry) {
+      uint32_t _v3 = (((_v * _v) >> 16) * _v) >> 16;
+      uint32_t _h = ((((_u * _v3) >> 16) *
+                      (16384 + ((uint32_t(_u) * 3) >> 2))) >> 14);
+      _s += (_h * _entry) >> 16;
+    }
+    if(_exit) {
+      uint32_t _h = ((((_u3 * _v) >> 16) *
+                      (65536 - ((uint32_t(_u) * 3) >> 2))) >> 14);
+      _s -= (_h * _exit) >> 16;
+    }
+  }
+  if(_s < 0) {
+    return 0;
+  }
+  if(_s > 0xFFFF) {
+    return 0xFFFF;
+  }
+  return _s;
+}
+
+/**
+ * Computes the Q16.16 pulse increment of a profiled sweep up to a phase.
+ *
+ * @param _ch channel index.
+ * @param _left timer ticks left to the deadline at the phase.
+ * @return pulse ticks increment.
+ */
+inline int32_t SerialServo::raw_profileIncrement(const uint8_t &_ch,
+                                                 const int32_t &_left) {
+  uint32_t _phase = raw_sweepPhase(data[_ch].rateTicks, _left);
+  uint16_t _pos = raw_profilePos(data[_ch].profile, _phase,
+                                 uint16_t(data[_ch].entrySpeed) * JUNCTION_SCALE,
+                                 uint16_t(data[_ch].exitSpeed) * JUNCTION_SCALE);
+  if(_pos < data[_ch].profilePos) {
+    _pos = data[_ch].profilePos;                // Rounding never goes back.
+  }
+  uint16_t _step = _pos - data[_ch].profilePos;
+  data[_ch].profilePos = _pos;
+  return int32_t(data[_ch].sweepTicks) * _step;
+}
+
+/**
+ * See readClock.
+ * The overflow count and TCNT1 are read together with interrupts disabled, an
+ * overflow still pending is added if TCNT1 has already wrapped.
+ *
+ * @return clock ticks.
+ */
+inline uint32_t SerialServo::raw_readClock() {
+  cli();
+  uint16_t _ticks = TCNT1;
+  uint16_t _overflows = overflows;
+  if((TIFR1 & _BV(TOV1)) && _ticks < 0x8000) {
+    _overflows++;
+  }
+  sei();
+  return (uint32_t(_overflows) << 16) | _ticks;
+}
+
+/**
+ * Adds a sample to the timing statistics, see printTiming.
+ *
+ * @param _block bank index.
+ * @param _type timing type.
+ * @param _ticks sample in timer ticks.
+ * @param _base lower bound of the first bucket.
+ * @param _shift log2 of the bucket size.
+ */
+inline void SerialServo::raw_timingRecord(const uint8_t &_block,
+                                          const uint8_t &_type,
+                                          const uint16_t &_ticks,
+                                          const uint16_t &_base,
+                                          const uint8_t &_shift) {
+#if SERIAL_SERVO_TIMING
+  volatile servo_timing_t &_timing = timing[_block][_type];
+  if(_ticks < _timing.minTicks) {
+    _timing.minTicks = _ticks;
+  }
+  if(_ticks > _timing.maxTicks) {
+    _timing.maxTicks = _ticks;
+  }
+  uint16_t _idx = 0;
+  if(_ticks > _base) {
+    _idx = (_ticks - _base) >> _shift;
+    if(_idx >= TIMING_BUCKETS) {
+      _idx = TIMING_BUCKETS - 1;
+    }
+  }
+  if(_timing.bucket[_idx] != 0xFFFF) {
+    _timing.bucket[_idx]++;
+  }
+#endif
+}
+
+#if SERIAL_SERVO_TIMING
+  #define timingStart() uint16_t _timing_entry = TCNT1
+  #define timingRecord(__block, __type, __ticks)                                \
+    raw_timingRecord(__block, __type, __ticks, __type##_BASE, __type##_SHIFT)
+#else
+  #define timingStart()
+  #define timingRecord(__block, __type, __ticks)
+#endif
+
+/**
+ * Checks if is elapsed enought time to set the movments as completed.
+ * It runs when the earliest deadline expires, see checkTime, and checks every
+ * channel so that each movement is completed on its own deadline. The next
+ * check is scheduled on the earliest deadline still pending, or after
+ * CHECK_MAX_TICKS if no movement is pending.
  */
 inline void SerialServo::raw_movementCheck() {
-  static uint8_t _ch = SERIAL_SERVO_BANKA_LOW;
-  
-  uint16_t _elapsed = TCNT1 - data[_ch].lastUpdate;
-  data[_ch].lastUpdate += _elapsed;
-  
+  uint32_t _now = raw_readClock();
+  uint32_t _next = _now + CHECK_MAX_TICKS;
+  uint32_t _finished = 0;
+  for(uint8_t _ch = SERIAL_SERVO_BANKA_LOW; _ch <= SERIAL_SERVO_BANKB_UP; _ch++) {
+    raw_channelCheck(_ch, _now, _next, _finished);
+  }
+  checkTime = _next;
+  if(_finished) {
+    // Staged sweeps that end together are released on the same frame.
+    cli();
+    frameMask |= _finished;
+    frameCommit = true;
+    sei();
+  }
+}
+
+/**
+ * Completes the movement of a channel if its deadline is expired.
+ *
+ * @param _ch channel index.
+ * @param _now clock value of the check.
+ * @param _next earliest pending deadline, updated in place.
+ * @param _finished channels of started staged sweeps completed by the check,
+ * updated in place, they wait for the next frame commit.
+ */
+inline void SerialServo::raw_channelCheck(const uint8_t &_ch,
+                                          const uint32_t &_now,
+                                          uint32_t &_next,
+                                          uint32_t &_finished) {
+  int32_t _left = data[_ch].deadlineTicks - _now;
   if(!data[_ch].pulseReached) {
-    data[_ch].actionTicks -= _elapsed;
-    if(data[_ch].actionTicks <= 0) {
-      data[_ch].eachusTicks = 0;
+    if(_left > 0) {
+      if(int32_t(data[_ch].deadlineTicks - _next) < 0) {
+        _next = data[_ch].deadlineTicks;
+      }
+    }
+    else {
+      // A sequence can start already expired, in that case only the time
+      // since the check was due is counted as lateness.
+      timingRecord(_ch > SERIAL_SERVO_BANKA_UP, TIMING_LATENESS,
+                   int32_t(checkTime - data[_ch].deadlineTicks) > 0 ?
+                   _now - checkTime : -_left);
+      bool _group = frameGroup & (1UL << _ch);
+      if(_group) {
+        data[_ch].updateDisabled = true;
+      }
+      data[_ch].rateTicks = 0;
       if(data[_ch].deltaTicks) {
-        data[_ch].incrementTicks = data[_ch].deltaTicks;
+        data[_ch].incrementTicks = int32_t(data[_ch].deltaTicks) <<
+                                   INCREMENT_FRACT_BITS;
+      }
+      if(_group) {
+        frameGroup &= ~(1UL << _ch);
+        _finished |= 1UL << _ch;
+      }
+      else {
+        data[_ch].updateDisabled = false;             // ATOMIC BLOCK
       }
-      data[_ch].updateDisabled = false;             // ATOMIC BLOCK
       data[_ch].pulseReached = true;
-      //Serial.println(millis()-start[_ch]);
     }
   }
-  else {
-    if(sequence) {
-      data[_ch].actionTicks -= _elapsed;
-    }
-  }
-  
-  if(++_ch > SERIAL_SERVO_BANKB_UP) {
-    _ch = SERIAL_SERVO_BANKA_LOW;
+  else if(_left < -SEQUENCE_MAX_TICKS) {
+    // Caps the time a sequence can catch up, so it never overflows.
+    data[_ch].deadlineTicks = _now - SEQUENCE_MAX_TICKS;
   }
 }
 
@@ -577,10 +1517,27 @@ inline void SerialServo::raw_incrementCalculator() {
   static uint8_t _actual_ch[SERIAL_SERVO_BANKS];
   uint8_t _next_ch = channel[_block];
   if(_next_ch != _actual_ch[_block]) {
-    if(data[_next_ch].eachusTicks) {
-      data[_next_ch].incrementTicks += period[_block] /
-                                       data[_next_ch].eachusTicks;
-      data[_next_ch].updateDisabled = false;
+    // A staged sweep is held as reached until raw_frameRelease.
+    if(data[_next_ch].rateTicks && !data[_next_ch].pulseReached) {
+      uint16_t _period = period[_block];
+      if(data[_next_ch].profile == SWEEP_LINEAR) {
+#if SERIAL_SERVO_FLOAT_SWEEP
+        data[_next_ch].incrementTicks += int32_t(data[_next_ch].rateFloat *
+                                                 _period *
+                                                 (1L << INCREMENT_FRACT_BITS));
+#else
+        data[_next_ch].incrementTicks += raw_rateIncrement(data[_next_ch].rateTicks,
+                                                           _period);
+#endif
+      }
+      else {
+        // The channel is the next one pulsed, so the phase is taken from now.
+        int32_t _left = data[_next_ch].deadlineTicks - raw_readClock();
+        data[_next_ch].incrementTicks += raw_profileIncrement(_next_ch, _left);
+      }
+      if(!frameGroup || !raw_frameArrives(_next_ch)) {
+        data[_next_ch].updateDisabled = false;
+      }
     }
     _actual_ch[_block] = _next_ch;
   }
@@ -592,7 +1549,12 @@ inline void SerialServo::raw_incrementCalculator() {
  */
  
 void SerialServo::servoRoutine() {
-  raw_movementCheck();
+  if(frameHeld && !frameCommit) {
+    raw_frameRelease();
+  }
+  if(int32_t(raw_readClock() - checkTime) >= 0) {
+    raw_movementCheck();
+  }
   raw_incrementCalculator();
 }
 
@@ -602,19 +1564,44 @@ void SerialServo::servoRoutine() {
  * start again from __block_low.
  * To do this we pulse the reset pin of the counter this sets output 0 of the
  * counter high, effectivley starting the first pulse of our first channel.
+ * __reset_hook is executed once per frame, when the reset pulse is scheduled.
+ * With SERIAL_SERVO_HWCLOCK the clock line is raised by the output compare
+ * unit on the match, the routine only forces it low again and __pulse_pin is
+ * 0 so that only the reset pulse is still sent by software.
  * 
  */
- 
-#define raw_interrupt(__block, __block_low, __block_upp, __timer_reg, __pin_reg, __pulse_pin, __reset_pin) {\
+
+#if SERIAL_SERVO_HWCLOCK
+  // Switches OCx to clear on match, forces a match and switches it back to set
+  // on match. Only the COMx0 bit of this bank is touched so the other bank
+  // keeps raising its line even if its match happens in the meantime.
+  #define raw_clockRelease(__com_bit, __force_bit) {                            \
+    TCCR1A &= ~_BV(__com_bit);                                                 \
+    TCCR1C = _BV(__force_bit);                                                 \
+    TCCR1A |= _BV(__com_bit);                                                  \
+  }
+  #define HWCLOCK_PULSE_PIN(_pin) 0
+#else
+  #define raw_clockRelease(__com_bit, __force_bit)
+  #define HWCLOCK_PULSE_PIN(_pin) PORTB_PIN(_pin)
+#endif
+
+#define raw_interrupt(__block, __block_low, __block_upp, __timer_reg, __pin_reg, __pulse_pin, __reset_pin, __com_bit, __force_bit, __reset_hook) {\
   static uint8_t _pin_to_pulse = __reset_pin;                                  \
+  timingStart();                                                               \
                                                                                \
-  __pin_reg |= _pin_to_pulse;                                                  \
-  __pin_reg ^= _pin_to_pulse;                                                  \
+  raw_clockRelease(__com_bit, __force_bit);                                    \
+  if(_pin_to_pulse) {                                                          \
+    __pin_reg |= _pin_to_pulse;                                                \
+    __pin_reg ^= _pin_to_pulse;                                                \
+  }                                                                            \
+  timingRecord(__block, TIMING_LATENCY, _timing_entry - __timer_reg);          \
                                                                                \
   sei();                                                                       \
   if(!data[ channel[__block] ].updateDisabled) {                               \
-    int16_t _increment = data[ channel[__block] ].incrementTicks;              \
-    data[ channel[__block] ].incrementTicks -= _increment;                     \
+    int16_t _increment = data[ channel[__block] ].incrementTicks >>           \
+                         INCREMENT_FRACT_BITS;                                 \
+    data[ channel[__block] ].incrementTicks &= INCREMENT_FRACT_MASK;           \
     data[ channel[__block] ].pulseTicks += _increment;                         \
     data[ channel[__block] ].deltaTicks -= _increment;                         \
     period[__block] += _increment;                                             \
@@ -626,30 +1613,36 @@ void SerialServo::servoRoutine() {
   if(++channel[__block] > __block_upp) {                                       \
     channel[__block] = __block_low;                                            \
     _pin_to_pulse = __reset_pin;                                               \
+    timingRecord(__block, TIMING_PERIOD, uint16_t(period[__block]));           \
+    __reset_hook;                                                              \
   }                                                                            \
   else {                                                                       \
     _pin_to_pulse = __pulse_pin;                                               \
   }                                                                            \
+  timingRecord(__block, TIMING_DURATION, TCNT1 - _timing_entry);               \
+}
+
+/**
+ * Counts the Timer1 overflows, see readClock.
+ */
+inline void SerialServo::OVF1_ISR() {
+  overflows++;
 }
 
 /**
  * See raw_interrupt.
  */
 inline void SerialServo::OCR1A_ISR() {
-  /*static uint32_t _time = micros();
-  uint32_t _time2 = micros();
-  if(channel[SERIAL_SERVO_BANKA] == 0) {
-    Serial.println(usToTicks(_time2-_time));
-    Serial.println(period[SERIAL_SERVO_BANKA]);
-    _time = _time2;
-  }*/
   raw_interrupt(SERIAL_SERVO_BANKA,
                 SERIAL_SERVO_BANKA_LOW,
                 SERIAL_SERVO_BANKA_UP,
                 OCR1A,
                 PORTB,
-                PORTB_PIN(BANKA_PULSE_PIN),
-                PORTB_PIN(BANKA_RST_PIN));
+                HWCLOCK_PULSE_PIN(BANKA_PULSE_PIN),
+                PORTB_PIN(BANKA_RST_PIN),
+                COM1A0,
+                FOC1A,
+                raw_frameCommit());
 }
  
 /**
@@ -661,8 +1654,11 @@ inline void SerialServo::OCR1B_ISR() {
                 SERIAL_SERVO_BANKB_UP,
                 OCR1B,
                 PORTB,
-                PORTB_PIN(BANKB_PULSE_PIN),
-                PORTB_PIN(BANKB_RST_PIN));
+                HWCLOCK_PULSE_PIN(BANKB_PULSE_PIN),
+                PORTB_PIN(BANKB_RST_PIN),
+                COM1B0,
+                FOC1B,
+                raw_frameLatch());
 }
 
 // Timer1 Output Compare A interrupt service routine.
@@ -673,4 +1669,9 @@ ISR(TIMER1_COMPA_vect) {
 // Timer1 Output Compare B interrupt service routine.
 ISR(TIMER1_COMPB_vect) {
   SerialServo::OCR1B_ISR();
+}
+
+// Timer1 Overflow interrupt service routine.
+ISR(TIMER1_OVF_vect) {
+  SerialServo::OVF1_ISR();
 }
\ No newline at end of file
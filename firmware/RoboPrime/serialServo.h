@@ -31,6 +31,11 @@
  *    generate the clock signalfor the second 4017 counter (Bank B).
  *  - Pin 13 is used as the reset pin for the second 4017 counter (Bank B).
  * 
+ * A channel can also be trimmed: the trim is added to its pulse through the
+ * pending increment, as a width is, and to every width or sweep target set
+ * later, within the channel bounds. Closed loop corrections never disturb the
+ * planned movements and the interrupts do no extra work for them.
+ * 
  * Thanks to DuaneB for the idea of using 4017.
  */
 
@@ -42,6 +47,7 @@
 #define SERIAL_SERVO_BANKB_LOW     10     // Bank A lower-bound index.
 #define SERIAL_SERVO_BANKB_UP      19     // Bank A upper-bound index.
 #define SERIAL_SERVO_CHANNELS      20     // Number of channels.
+#define SERIAL_SERVO_BANKB_MASK 0xFFC00UL // Bank B channels bits.
 
 #define SERIAL_SERVO_BANKS          2
 #define SERIAL_SERVO_BANKA          0
@@ -80,15 +86,116 @@
 
 #define PORTB_PIN(_pin) (1 << (_pin-8))
 
+// Set to 1 to let the Timer1 output compare units raise the 4017 clock lines
+// (OC1A on pin 9, OC1B on pin 10) exactly on the compare match. The interrupt
+// only releases the line and schedules the next edge, so the interrupt latency
+// no longer shows up as pulse width jitter. The tenth clock of a bank wraps
+// the 4017 from Q9 to Q0 and the reset pulse that follows keeps it there.
+#ifndef SERIAL_SERVO_HWCLOCK
+  #define SERIAL_SERVO_HWCLOCK      0
+#endif
+
+// Compare output modes for TCCR1A, see raw_clockRelease.
+#define HWCLOCK_SET     (_BV(COM1A1) | _BV(COM1A0) | _BV(COM1B1) | _BV(COM1B0))
+#define HWCLOCK_CLEAR   (_BV(COM1A1) | _BV(COM1B1))
+
+// Set to 1 to record the interrupt timing statistics, see printTiming.
+#ifndef SERIAL_SERVO_TIMING
+  #define SERIAL_SERVO_TIMING       0
+#endif
+
+#define TIMING_LATENCY              0     // Compare match to ISR entry.
+#define TIMING_DURATION             1     // ISR entry to ISR exit.
+#define TIMING_PERIOD               2     // Bank frame period from period[].
+#define TIMING_LATENESS             3     // Movement deadline to completion.
+#define TIMING_SIZE                 4
+#define TIMING_BUCKETS              8
+
+// Histogram bucket i counts values in [BASE + i << SHIFT, BASE + (i+1) << SHIFT)
+// timer ticks, the last bucket also counts everything above.
+#define TIMING_LATENCY_BASE         0
+#define TIMING_LATENCY_SHIFT        2     // 2us buckets.
+#define TIMING_DURATION_BASE        0
+#define TIMING_DURATION_SHIFT       3     // 4us buckets.
+#define TIMING_PERIOD_BASE      16384     // 8.192ms.
+#define TIMING_PERIOD_SHIFT        12     // 2.048ms buckets.
+#define TIMING_LATENESS_BASE        0
+#define TIMING_LATENESS_SHIFT       8     // 128us buckets.
+
+// Sweeps are computed in fixed point to avoid any float math on the MCU.
+// The sweep rate is a Q0.31 number of pulse ticks per timer tick and the
+// pending increment a Q16.16 number of pulse ticks.
+#define RATE_FRACT_BITS            31
+#define RATE_MAX           (1L << 29)     // 0.25 pulse ticks per timer tick.
+#define INCREMENT_FRACT_BITS       16
+#define INCREMENT_FRACT_MASK   0xFFFF
+
+// Set to 1 to compute the increments of the linear sweeps from a float rate,
+// as before the fixed point math. It is the reference of the HostSim sweep
+// test and is not meant for the MCU.
+#ifndef SERIAL_SERVO_FLOAT_SWEEP
+  #define SERIAL_SERVO_FLOAT_SWEEP  0
+#endif
+
+// Sweep profiles. Profiles other than SWEEP_LINEAR follow a Q0.16 position
+// curve of the sweep phase, a Q0.31 fraction of the sweep time computed from
+// the time left to the deadline, see raw_sweepPhase.
+#define SWEEP_LINEAR                0     // Constant velocity.
+#define SWEEP_TRAPEZOID             1     // Accelerates on the first quarter, brakes on the last.
+#define SWEEP_SCURVE                2     // Minimum jerk, 10u^3 - 15u^4 + 6u^5.
+#define SWEEP_SIZE                  3
+#define PHASE_FRACT_BITS           31
+#define PHASE_END         (1UL << 31)
+#define PROFILE_QUARTER         16384     // Q0.16.
+#define PROFILE_CRUISE          87381     // 4/3 in Q0.16, trapezoid top speed.
+#define PROFILE_SIXTH           10923     // 1/6 in Q0.16.
+
+// A profiled sweep can start and end at a junction speed instead of standing
+// still, see blendSweep. Junction speeds are Q0.8 fractions of the average
+// speed of the sweep, JUNCTION_FULL being the average speed itself.
+#define JUNCTION_STOP               0
+#define JUNCTION_FULL             255
+#define JUNCTION_SCALE            257     // Q0.8 to Q0.16.
+
+// Movements are completed on their deadline, see raw_movementCheck. Deadlines
+// are values of the 32 bit clock, see readClock. A check runs at least every
+// CHECK_MAX_TICKS so that a sequence never catches up more than
+// SEQUENCE_MAX_TICKS, which is longer than any movement.
+#define CHECK_MAX_TICKS     (1L << 30)    // ~9 minutes.
+#define SEQUENCE_MAX_TICKS  (1L << 28)    // ~134 seconds.
+
+// Angles are converted with a per-channel linear scale computed at begin().
+// Each channel costs 4 bytes of SRAM (80 bytes in total) and a conversion is a
+// single 16x16 bit multiplication plus a shift.
+#define SCALE_DEG_BITS             14     // Q2.14 pulse ticks per angle unit.
+#define SCALE_TICKS_BITS           16     // Q0.16 angle units per pulse tick.
+
+struct servo_scale_t {
+  uint16_t degTicks;
+  uint16_t ticksDeg;
+};
+
+struct servo_timing_t {
+  uint16_t minTicks, maxTicks;
+  uint16_t bucket[TIMING_BUCKETS];
+};
+
 struct servo_data_t {
   bool pulseReached;
-  float eachusTicks;
-  uint16_t lastUpdate;
-  int32_t actionTicks;
+  int32_t rateTicks;                  // Sweep rate, or phase rate if profiled.
+#if SERIAL_SERVO_FLOAT_SWEEP
+  float rateFloat;                    // Pulse ticks per timer tick.
+#endif
+  uint32_t deadlineTicks;
+  uint8_t profile;
+  uint16_t profilePos;
+  int16_t sweepTicks;
+  uint8_t entrySpeed, exitSpeed;
   volatile bool updateDisabled;
   volatile int16_t deltaTicks;
-  volatile float incrementTicks;
+  volatile int32_t incrementTicks;
   volatile uint16_t pulseTicks;
+  int16_t trimTicks;                  // Part of pulseTicks, see raw_trimTicks.
 };
     
 class SerialServo {
@@ -101,20 +208,40 @@ class SerialServo {
     static uint16_t readWidth(uint8_t _ch, bool _inverted = false);
     static uint16_t readAngle(uint8_t _ch, bool _inverted = false);
     static void sweepWidth(uint8_t _ch, uint16_t _us, uint16_t _time,
-                           bool _inverted = false);
+                           bool _inverted = false,
+                           uint8_t _profile = SWEEP_LINEAR);
     static void sweepAngle(uint8_t _ch, uint16_t _deg, uint16_t _time,
-                           bool _inverted = false);
+                           bool _inverted = false,
+                           uint8_t _profile = SWEEP_LINEAR);
+    static void blendSweep(uint8_t _ch, uint8_t _entry, uint8_t _exit);
+    static void trimAngle(uint8_t _ch, int16_t _deg, bool _inverted = false);
     static void wait(uint8_t _ch, uint16_t _time);
     static uint16_t readMinWidth(uint8_t _ch, bool _inverted = false);
     static uint16_t readMaxWidth(uint8_t _ch, bool _inverted = false);
     static bool isMoving(uint8_t _ch);
+    static void stageWidth(uint8_t _ch, uint16_t _us, bool _inverted = false);
+    static void stageAngle(uint8_t _ch, uint16_t _deg, bool _inverted = false);
+    static void stageSweepWidth(uint8_t _ch, uint16_t _us, uint16_t _time,
+                                bool _inverted = false,
+                                uint8_t _profile = SWEEP_LINEAR);
+    static void stageSweepAngle(uint8_t _ch, uint16_t _deg, uint16_t _time,
+                                bool _inverted = false,
+                                uint8_t _profile = SWEEP_LINEAR);
+    static void commitFrame();
+    static bool isFramePending();
+    static void printTiming();
+    static void clearTiming();
+    static uint32_t readClock();
+    static uint32_t readDeadline(uint8_t _ch);
     static void enableSequence();
+    static void setSequenceStart(uint8_t _ch, uint32_t _start);
     static void disableSequence();
     
     static void servoRoutine();
     
     static void OCR1A_ISR();
     static void OCR1B_ISR();
+    static void OVF1_ISR();
   private:
     // No-one have to create an istance of this class as we use it as
     // a singleton, so we keep constructor as private.
@@ -123,29 +250,73 @@ class SerialServo {
     // All raw_ function declared here do not check the validity of the passed
     // arguments for speed reasons. They are supposed to be used only internally.
     
-    static uint16_t raw_degToUs(const uint8_t &_ch, const uint16_t &_deg);
-    static uint16_t raw_usToDeg(const uint8_t &_ch, const uint16_t &_us);
+    static uint16_t raw_degToTicks(const uint8_t &_ch, const uint16_t &_deg);
+    static uint16_t raw_ticksToDeg(const uint8_t &_ch, const uint16_t &_ticks);
     static uint16_t raw_validWidth(const uint8_t &_ch, const uint16_t &_us);
     static uint16_t raw_validAngle(const uint8_t &_ch, const uint16_t &_deg);
     static uint16_t raw_invertWidth(const uint8_t &_ch, const uint16_t &_us);
     static uint16_t raw_invertAngle(const uint8_t &_ch, const uint16_t &_deg);
     
-    static void raw_writeWidth(const uint8_t &_ch, const uint16_t &_us);
+    static void raw_writeTicks(const uint8_t &_ch, const uint16_t &_ticks);
     static uint16_t raw_readWidth(const uint8_t &_ch);
-    static void raw_sweepWidth(const uint8_t &_ch, const uint16_t &_us,
-                               const uint16_t &_time);
+    static uint16_t raw_readTicks(const uint8_t &_ch);
+    static void raw_sweepTicks(const uint8_t &_ch, const uint16_t &_ticks,
+                               const uint16_t &_time, const uint8_t &_profile);
+    static void raw_sweepStart(const uint8_t &_ch, const uint16_t &_ticks,
+                               const int32_t &_time, const uint8_t &_profile);
     static void raw_wait(const uint8_t &_ch, const uint16_t &_time);
+    static void raw_trimTicks(const uint8_t &_ch, int16_t _ticks);
+    static uint16_t raw_trimmedTicks(const uint8_t &_ch,
+                                     const uint16_t &_ticks);
+    static void raw_stageTicks(const uint8_t &_ch, const uint16_t &_ticks);
+    static void raw_stageSweep(const uint8_t &_ch, const uint16_t &_ticks,
+                               const uint16_t &_time, const uint8_t &_profile);
+    static void raw_scheduleCheck(const uint8_t &_ch);
+    static void raw_frameCommit();
+    static void raw_frameLatch();
+    static void raw_frameRelease();
+    static bool raw_frameArrives(const uint8_t &_ch);
+    static void raw_frameDrop(const uint8_t &_ch);
     static uint16_t raw_readMinWidth(const uint8_t &_ch);
     static uint16_t raw_readMaxWidth(const uint8_t &_ch);
     
+    static int32_t raw_sweepRate(const int16_t &_delta, const int32_t &_time);
+    static int32_t raw_rateIncrement(const int32_t &_rate,
+                                     const uint16_t &_period);
+    static uint32_t raw_sweepPhase(const int32_t &_rate, const int32_t &_left);
+    static uint16_t raw_profilePos(const uint8_t &_profile,
+                                   const uint32_t &_phase,
+                                   const uint16_t &_entry,
+                                   const uint16_t &_exit);
+    static int32_t raw_profileIncrement(const uint8_t &_ch,
+                                        const int32_t &_left);
+
+    static void raw_timingRecord(const uint8_t &_block, const uint8_t &_type,
+                                 const uint16_t &_ticks, const uint16_t &_base,
+                                 const uint8_t &_shift);
+
+    static uint32_t raw_readClock();
     static void raw_movementCheck();
+    static void raw_channelCheck(const uint8_t &_ch, const uint32_t &_now,
+                                 uint32_t &_next, uint32_t &_finished);
     static void raw_incrementCalculator();
     
     static bool sequence;
+    static volatile uint16_t overflows;
+    static uint32_t checkTime;
+    static uint32_t frameStaged;
+    static uint32_t frameSweep, frameHeld, frameGroup;
+    static uint32_t frameClock;
+    static volatile uint32_t frameMask, frameLatch;
+    static volatile bool frameCommit;
     static volatile uint16_t channel[SERIAL_SERVO_BANKS];
     static volatile uint16_t period[SERIAL_SERVO_BANKS];
     static servo_data_t data[SERIAL_SERVO_CHANNELS];
+    static servo_scale_t scale[SERIAL_SERVO_CHANNELS];
     static const PROGMEM uint16_t bound[SERIAL_SERVO_CHANNELS][BOUND_SIZE];
+#if SERIAL_SERVO_TIMING
+    static volatile servo_timing_t timing[SERIAL_SERVO_BANKS][TIMING_SIZE];
+#endif
 };
 
 #endif
\ No newline at end of file
@@ -22,12 +22,15 @@
  *
  * This convert an xml file with timing about animation steps into code used by the animation
  * routine in the RoboPrime firmware.
+ * It also writes the E commands that upload the same steps into the EEPROM slot 0 through
+ * the serial port, one per line, see CommandParser::parseCodeE.
  *
  */
 
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <sstream>
 #include <queue>
 #include "lib/pugixml.hpp"
 #include "lib/pugixml.cpp"
@@ -135,8 +138,8 @@ int main() {
 				return 5+(i*5);
 			}
 			parsed.duration = mov_container.attribute("duration").as_int(-1.0);
-			if(parsed.duration < 0 || parsed.duration > 60000) {
-				std::cout << "XML [" << source << "] Fatal Error: 'duration' attribute have to be in range '0-60000'." << std::endl;
+			if(parsed.duration < 0 || parsed.duration > 8191) {
+				std::cout << "XML [" << source << "] Fatal Error: 'duration' attribute have to be in range '0-8191'." << std::endl;
 				return 6+(i*5);
 			}
 			queue[i].push(parsed);
@@ -145,6 +148,8 @@ int main() {
 	std::cout << "XML [" << source << "] Info: Sanity check passed!" << std::endl;
 
 	int last_end[2][10] ={{0}};
+	int steps[3] = {0};
+	std::ostringstream upload;
 	std::string output = filename + ".cpp";
 	std::ofstream fout(output.c_str());
 	std::cout << "XML [" << output << "] Info: Starting code generation..." << std::endl;
@@ -167,9 +172,13 @@ int main() {
 			}
 			int dif = actual.start - last_end[actual.half][actual.idx];
 			if(dif) {
-				fout << "{" << hf_name(actual.half) <<", " << idx_name(actual.idx) << ", INVALID_BODY_POS, " << dif << "}," << std::endl;
+				fout << "ANIM_WAIT(" << hf_name(actual.half) <<", " << idx_name(actual.idx) << ", " << dif << ")," << std::endl;
+				upload << "E1 " << (actual.half ? 'L' : 'R') << actual.idx << " D" << dif << std::endl;
+				steps[i]++;
 			}
-			fout << "{" << hf_name(actual.half) <<", " << idx_name(actual.idx) << ", " << actual.angle << ", " << actual.duration << "}," << std::endl;
+			fout << "ANIM_MOVE(" << hf_name(actual.half) <<", " << idx_name(actual.idx) << ", " << actual.angle << ", " << actual.duration << ")," << std::endl;
+			upload << "E1 " << (actual.half ? 'L' : 'R') << actual.idx << " A" << actual.angle << " D" << actual.duration << std::endl;
+			steps[i]++;
 			last_end[actual.half][actual.idx] = actual.start + actual.duration;
 			if(max_end < last_end[actual.half][actual.idx]) max_end = last_end[actual.half][actual.idx];
 		}
@@ -178,7 +187,9 @@ int main() {
 				if(last_end[j][k] != 0) {
 					int max_dif = max_end - last_end[j][k];
 					if(max_dif) {
-						fout << "{" << hf_name(j) << ", " << idx_name(k) << ", INVALID_BODY_POS, " << max_dif << "}," << std::endl;
+						fout << "ANIM_WAIT(" << hf_name(j) << ", " << idx_name(k) << ", " << max_dif << ")," << std::endl;
+						upload << "E1 " << (j ? 'L' : 'R') << k << " D" << max_dif << std::endl;
+						steps[i]++;
 					}
 					last_end[j][k] = 0;
 				}
@@ -188,5 +199,17 @@ int main() {
 	}
 	fout.close();
 	std::cout << "XML [" << output << "] Code generated!" << std::endl;
+
+	output = filename + ".txt";
+	std::ofstream uout(output.c_str());
+	if(!uout) {
+		std::cout << "XML [" << output << "] Fatal Error: the program does not have write permissions in this folder." << std::endl;
+		return 18;
+	}
+	uout << "E0 A0 S" << steps[0] << " P" << steps[1] << " N" << steps[2] << std::endl;
+	uout << upload.str();
+	uout << "E2" << std::endl;
+	uout.close();
+	std::cout << "XML [" << output << "] Upload commands generated!" << std::endl;
 	return 0;
 }
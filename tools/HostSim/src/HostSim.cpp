@@ -0,0 +1,769 @@
+/**
+ * Tool of RoboPrime Firmware.
+ *
+ * HostSim.cpp
+ * Runs the RoboPrime firmware on a Linux box against a virtual Timer1.
+ *
+ * RoboPrime Firmware, (https://github.com/simonepri/RoboPrime)
+ * Copyright (c) 2015, Simone Primarosa, (https://simoneprimarosa.com)
+ *
+ * Licensed under The MIT License
+ * Redistribution of file must retain the above copyright notice.
+ *
+ * @copyright     Copyright (c) 2015, Simone Primarosa, (https://simoneprimarosa.com)
+ * @link          (https://github.com/simonepri/RoboPrime)
+ * @since         0.0.0
+ * @license       MIT License (https://opensource.org/licenses/MIT)
+ */
+
+/*
+ * PURPOSE:
+ *
+ * The firmware sources are compiled unmodified against the headers in
+ * src/shim and linked with this file, which provides the register storage,
+ * the Serial port and a virtual clock.
+ *
+ * The clock counts Timer1 ticks (0.5us with the firmware prescaler). Every
+ * call to loop() is charged a fixed number of ticks, and while the clock
+ * advances the compare-match vectors are called exactly when TCNT1 reaches
+ * OCR1A/OCR1B, so a simulated minute runs in a fraction of a second.
+ *
+ * PORTB writes drive a model of the two 4017 counters, which gives back the
+ * pulse width that every servo output actually sees.
+ *
+ * TWCR writes drive a model of the I2C bus at 400kHz with an MPU-6050 on it:
+ * each start, address and data byte ends after its bus time, then TWINT is
+ * set and the TWI vector is called, as on the chip. The sensor wakes up from
+ * sleep like the real one and reports the accelerations and the rates of a
+ * trunk that rocks on pitch and roll, see -m. It can also hold the bus, see
+ * -s: a bus action started meanwhile never ends, until TWEN is cleared.
+ *
+ * The EEPROM starts erased, or from an image file, see -e. Every byte that an
+ * update changes advances the clock by the write time, as the firmware waits
+ * for it with the interrupts enabled.
+ *
+ * Usage: HostSim [-t ms] [-l ticks] [-w] [-m pitch,roll,period[,bias]]
+ *                [-s from,to] [-e image] [-k] [script]
+ *  -t  simulated time to run, in milliseconds (default 10000).
+ *  -l  Timer1 ticks charged to each loop() call (default 100 = 50us).
+ *  -w  prints "<ms> <channel> <us>" every time a servo pulse width changes.
+ *  -m  rocks the trunk by pitch and roll (angle*10) with a period in ms, and
+ *      adds bias (LSB) to every gyroscope rate. It stands still by default.
+ *  -s  the sensor holds SDA low from one simulated time to the other, in ms.
+ *  -e  loads the EEPROM from an image file, if it exists, and saves it back
+ *      at the end, so uploaded animations survive between runs.
+ *  -k  acts as a streaming host: a Q0 line is only sent for a credit granted
+ *      by a "G <credits>" line of the firmware, and waits for it otherwise,
+ *      holding the lines after it. See the Q2 command.
+ *  script  serial input, one command per line. A line starting with
+ *          "@<ms>" is held back until that simulated time. Bytes are
+ *          delivered at 115200 baud. Reads stdin if omitted.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <deque>
+
+#include "Arduino.h"
+#include "avr/eeprom.h"
+
+#define SIM_TICKS_PER_US            2     // Firmware prescaler: 8 = 2 ticks = 1us.
+#define SIM_BYTE_TICKS            174     // 10 bits at 115200 baud.
+
+#define SIM_PORTB_PULSE_A     _BV(1)      // Digital pin 9.
+#define SIM_PORTB_PULSE_B     _BV(2)      // Digital pin 10.
+#define SIM_PORTB_RST_A       _BV(4)      // Digital pin 12.
+#define SIM_PORTB_RST_B       _BV(5)      // Digital pin 13.
+
+#define SIM_CHANNELS               20
+#define SIM_BANK_CHANNELS          10
+
+#define SIM_TWI_START_TICKS         5     // Start condition, 2.5us.
+#define SIM_TWI_BYTE_TICKS         45     // 9 bits at 400kHz.
+#define SIM_MPU_ADDRESS          0x68
+#define SIM_MPU_REGS              128
+#define SIM_MPU_ACCEL_XOUT_H     0x3B
+#define SIM_MPU_PWR_MGMT_1       0x6B
+#define SIM_MPU_WHO_AM_I         0x75
+#define SIM_MPU_SLEEP            0x40
+#define SIM_MPU_LSB_G           16384     // +-2g.
+#define SIM_MPU_LSB_DPS           131     // +-250deg/s.
+
+#define SIM_EEPROM_SIZE     (E2END + 1)
+#define SIM_EEPROM_TICKS         6800     // Byte write, 3.4ms.
+
+#define SIM_TWI_FREE                0
+#define SIM_TWI_ADDRESS             1     // Next byte is SLA+R/W.
+#define SIM_TWI_WRITE               2
+#define SIM_TWI_READ                3
+#define SIM_TWI_IGNORED             4     // Another address was sent.
+
+volatile uint16_t TCNT1, OCR1A, OCR1B;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1, SREG;
+HostRegister8 PORTB(HOST_REG_PORTB), TIFR1(HOST_REG_FLAGS),
+              TCCR1C(HOST_REG_FORCE);
+volatile uint8_t TWBR, TWSR, TWDR, TWAR;
+HostRegister8 TWCR(HOST_REG_TWCR);
+HardwareSerial Serial;
+
+namespace HostSim {
+  typedef std::chrono::steady_clock host_clock;
+
+  struct cost_t {
+    uint32_t calls;
+    uint64_t totalNs, maxNs;
+  };
+
+  struct rx_t {
+    uint64_t at;
+    std::string line;
+  };
+
+  uint64_t clockTicks;
+  uint64_t loopTicks = 100;
+  bool interrupts = true;
+  bool traceWidth = false;
+
+  std::deque<rx_t> script;
+  std::deque<std::pair<uint64_t, char> > rx;
+  uint64_t rxFree;
+
+  int8_t counter[2] = {-1, -1};
+  uint64_t edge[2];
+  uint16_t width[SIM_CHANNELS];
+  uint32_t frames[2];
+
+  cost_t loopCost, isrCost[2], twiCost;
+
+  uint8_t twiPhase = SIM_TWI_FREE;
+  uint64_t twiDue;                          // 0 while the bus is idle.
+  uint8_t twiStatus, twiByte;
+  bool twiPointer;
+  uint32_t twiBursts;
+
+  uint8_t mpuReg[SIM_MPU_REGS];
+  uint8_t mpuPointer;
+  double rockPitch, rockRoll, rockPeriod, gyroBias;
+  uint64_t stallFrom, stallTo;
+
+  uint8_t eeprom[SIM_EEPROM_SIZE];
+  uint32_t eepromWrites;
+  uint64_t eepromReady;                     // End of the last byte write.
+
+  bool streamCredits = false;
+  uint32_t credits, heldLines;
+  bool holding;
+  uint64_t holdSince, heldTicks;              // Q0 lines waiting for credits.
+  std::string txLine;
+
+  /**
+   * Runs a function and charges its host time to a cost counter.
+   */
+  template<typename F> void measure(cost_t &_cost, F _f) {
+    host_clock::time_point _start = host_clock::now();
+    _f();
+    uint64_t _ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     host_clock::now() - _start).count();
+    _cost.calls++;
+    _cost.totalNs += _ns;
+    if(_ns > _cost.maxNs) {
+      _cost.maxNs = _ns;
+    }
+  }
+
+  /**
+   * Closes the pulse of the active 4017 output and opens the next one.
+   * A reset while Q0 is already high leaves the pulse running.
+   */
+  void counterEdge(uint8_t _bank, bool _reset) {
+    if(_reset && counter[_bank] == 0) {
+      return;
+    }
+    if(counter[_bank] >= 0) {
+      uint8_t _ch = _bank * SIM_BANK_CHANNELS + counter[_bank];
+      uint16_t _us = (clockTicks - edge[_bank]) / SIM_TICKS_PER_US;
+      if(_us != width[_ch]) {
+        width[_ch] = _us;
+        if(traceWidth) {
+          printf("%llu %u %u\n", (unsigned long long)(clockTicks / 2000),
+                 _ch, _us);
+        }
+      }
+    }
+    if(_reset) {
+      counter[_bank] = 0;
+    }
+    else if(counter[_bank] >= 0 && ++counter[_bank] >= SIM_BANK_CHANNELS) {
+      counter[_bank] = 0;                   // Q9 wraps to Q0.
+    }
+    if(counter[_bank] == 0) {
+      frames[_bank]++;
+    }
+    edge[_bank] = clockTicks;
+  }
+
+  /**
+   * Feeds the 4017 model with the rising edges of a PORTB write.
+   */
+  void portWrite(uint8_t _old, uint8_t _new) {
+    uint8_t _rise = ~_old & _new;
+    if(_rise & SIM_PORTB_RST_A) counterEdge(0, true);
+    else if(_rise & SIM_PORTB_PULSE_A) counterEdge(0, false);
+    if(_rise & SIM_PORTB_RST_B) counterEdge(1, true);
+    else if(_rise & SIM_PORTB_PULSE_B) counterEdge(1, false);
+  }
+
+  /**
+   * Applies the compare output mode of a channel to its OC1x pin.
+   */
+  void compareOutput(uint8_t _bank) {
+    uint8_t _com = (TCCR1A >> (_bank ? COM1B0 : COM1A0)) & 3;
+    uint8_t _pin = _bank ? SIM_PORTB_PULSE_B : SIM_PORTB_PULSE_A;
+    if(_com == 1) PORTB ^= _pin;
+    else if(_com == 2) PORTB &= ~_pin;
+    else if(_com == 3) PORTB |= _pin;
+  }
+
+  /**
+   * Applies the compare output mode of a channel and raises its interrupt.
+   */
+  void compareMatch(uint8_t _bank) {
+    compareOutput(_bank);
+    TIFR1.set(TIFR1 | (_bank ? _BV(OCF1B) : _BV(OCF1A)));
+  }
+
+  /**
+   * Stores a big endian value in two sensor registers.
+   */
+  void mpuWord(uint8_t _reg, double _value) {
+    long _v = lround(_value);
+    if(_v > 32767) _v = 32767;
+    if(_v < -32768) _v = -32768;
+    mpuReg[_reg] = uint16_t(_v) >> 8;
+    mpuReg[_reg + 1] = uint16_t(_v) & 0xFF;
+  }
+
+  /**
+   * Latches the sensor values of the rocking trunk, unless the sensor sleeps.
+   */
+  void mpuSample() {
+    if(mpuReg[SIM_MPU_PWR_MGMT_1] & SIM_MPU_SLEEP) {
+      return;
+    }
+    double _t = double(clockTicks) / (1000000 * SIM_TICKS_PER_US);
+    double _w = rockPeriod > 0 ? 2 * M_PI * 1000 / rockPeriod : 0;
+    double _deg = M_PI / 180;
+    double _p = rockPitch / 10 * sin(_w * _t) * _deg;
+    double _r = rockRoll / 10 * sin(_w * _t) * _deg;
+    double _dp = rockPitch / 10 * _w * cos(_w * _t);
+    double _dr = rockRoll / 10 * _w * cos(_w * _t);
+    // X forward, Y left, Z up: the accelerometer measures the reaction to
+    // gravity, the pitch turns around Y and the roll around -X.
+    mpuWord(SIM_MPU_ACCEL_XOUT_H, -sin(_p) * cos(_r) * SIM_MPU_LSB_G);
+    mpuWord(SIM_MPU_ACCEL_XOUT_H + 2, -sin(_r) * SIM_MPU_LSB_G);
+    mpuWord(SIM_MPU_ACCEL_XOUT_H + 4, cos(_p) * cos(_r) * SIM_MPU_LSB_G);
+    mpuWord(SIM_MPU_ACCEL_XOUT_H + 6, 0);
+    mpuWord(SIM_MPU_ACCEL_XOUT_H + 8, -_dr * SIM_MPU_LSB_DPS + gyroBias);
+    mpuWord(SIM_MPU_ACCEL_XOUT_H + 10, _dp * SIM_MPU_LSB_DPS + gyroBias);
+    mpuWord(SIM_MPU_ACCEL_XOUT_H + 12, gyroBias);
+  }
+
+  /**
+   * Starts the bus action asked by a TWCR write with TWINT set.
+   */
+  void twiControl(uint8_t _control) {
+    if(clockTicks >= stallFrom && clockTicks < stallTo) {
+      twiDue = 0;                           // Waits for SDA forever.
+      return;
+    }
+    if(_control & _BV(TWSTO)) {
+      twiPhase = SIM_TWI_FREE;
+      TWCR.set(TWCR & ~_BV(TWSTO));         // Cleared when the stop is sent.
+    }
+    if(_control & _BV(TWSTA)) {
+      twiStatus = twiPhase == SIM_TWI_FREE ? 0x08 : 0x10;
+      twiPhase = SIM_TWI_ADDRESS;
+      twiDue = clockTicks + SIM_TWI_START_TICKS;
+      return;
+    }
+    switch(twiPhase) {
+      case SIM_TWI_ADDRESS:
+        if((TWDR >> 1) != SIM_MPU_ADDRESS) {
+          twiStatus = (TWDR & 1) ? 0x48 : 0x20;
+          twiPhase = SIM_TWI_IGNORED;
+        }
+        else if(TWDR & 1) {
+          twiStatus = 0x40;
+          twiPhase = SIM_TWI_READ;
+          if(mpuPointer == SIM_MPU_ACCEL_XOUT_H) {
+            mpuSample();
+            twiBursts++;
+          }
+        }
+        else {
+          twiStatus = 0x18;
+          twiPhase = SIM_TWI_WRITE;
+          twiPointer = true;
+        }
+        break;
+      case SIM_TWI_WRITE:
+        if(twiPointer) {
+          mpuPointer = TWDR % SIM_MPU_REGS;
+          twiPointer = false;
+        }
+        else {
+          mpuReg[mpuPointer] = TWDR;
+          mpuPointer = (mpuPointer + 1) % SIM_MPU_REGS;
+        }
+        twiStatus = 0x28;
+        break;
+      case SIM_TWI_READ:
+        twiByte = mpuReg[mpuPointer];
+        mpuPointer = (mpuPointer + 1) % SIM_MPU_REGS;
+        twiStatus = (_control & _BV(TWEA)) ? 0x50 : 0x58;
+        break;
+      default:
+        return;
+    }
+    twiDue = clockTicks + SIM_TWI_BYTE_TICKS;
+  }
+
+  /**
+   * Ends the running bus action and raises the TWI interrupt flag.
+   */
+  void twiComplete() {
+    twiDue = 0;
+    if(twiStatus == 0x50 || twiStatus == 0x58) {
+      TWDR = twiByte;
+    }
+    TWSR = twiStatus;
+    TWCR.set(TWCR | _BV(TWINT));
+  }
+
+  /**
+   * Calls every pending and enabled Timer1 vector.
+   */
+  void dispatch() {
+    if(!interrupts) {
+      return;
+    }
+    // Vectors may re-enable interrupts, so the flags are read again after
+    // every call as a nested vector could already have served them.
+    if((TIFR1 & TIMSK1 & _BV(OCF1A)) && TIMER1_COMPA_vect) {
+      TIFR1.set(TIFR1 & ~_BV(OCF1A));
+      interrupts = false;
+      measure(isrCost[0], TIMER1_COMPA_vect);
+      interrupts = true;
+    }
+    if((TIFR1 & TIMSK1 & _BV(OCF1B)) && TIMER1_COMPB_vect) {
+      TIFR1.set(TIFR1 & ~_BV(OCF1B));
+      interrupts = false;
+      measure(isrCost[1], TIMER1_COMPB_vect);
+      interrupts = true;
+    }
+    if((TIFR1 & TIMSK1 & _BV(TOV1)) && TIMER1_OVF_vect) {
+      TIFR1.set(TIFR1 & ~_BV(TOV1));
+      interrupts = false;
+      TIMER1_OVF_vect();
+      interrupts = true;
+    }
+    // TWINT is only cleared by the vector itself, with a TWCR write.
+    if((TWCR & _BV(TWINT)) && (TWCR & _BV(TWIE)) && TWI_vect) {
+      interrupts = false;
+      measure(twiCost, TWI_vect);
+      interrupts = true;
+    }
+  }
+
+  /**
+   * Moves the virtual clock forward, stopping on every Timer1 event.
+   */
+  void advance(uint64_t _ticks) {
+    while(_ticks) {
+      uint64_t _step = _ticks;
+      bool _running = TCCR1B & (_BV(CS10) | _BV(CS11) | _BV(CS12));
+      if(_running) {
+        uint32_t _toA = uint16_t(OCR1A - TCNT1);
+        uint32_t _toB = uint16_t(OCR1B - TCNT1);
+        uint32_t _toOvf = 0x10000 - TCNT1;
+        if(!_toA) _toA = 0x10000;
+        if(!_toB) _toB = 0x10000;
+        if(_toA < _step) _step = _toA;
+        if(_toB < _step) _step = _toB;
+        if(_toOvf < _step) _step = _toOvf;
+      }
+      if(twiDue && twiDue - clockTicks < _step) {
+        _step = twiDue - clockTicks;
+      }
+      if(_running) {
+        TCNT1 += _step;
+      }
+      clockTicks += _step;
+      _ticks -= _step;
+      bool _event = false;
+      if(_running && _step) {
+        if(TCNT1 == 0) TIFR1.set(TIFR1 | _BV(TOV1));
+        if(TCNT1 == OCR1A) compareMatch(0);
+        if(TCNT1 == OCR1B) compareMatch(1);
+        _event = true;
+      }
+      if(twiDue && twiDue <= clockTicks) {
+        twiComplete();
+        _event = true;
+      }
+      if(_event) {
+        dispatch();
+      }
+    }
+  }
+
+  /**
+   * Moves due script lines into the UART receive queue. With -k the Q0 lines
+   * wait for credits, in order, while the other lines are sent on time.
+   */
+  void feedSerial() {
+    bool _held = false;
+    for(size_t _n = 0; _n < script.size() && script[_n].at <= clockTicks; ) {
+      std::string &_line = script[_n].line;
+      if(streamCredits && _line.compare(0, 2, "Q0") == 0) {
+        if(_held || !credits) {
+          if(!_held && !holding) {
+            holding = true;
+            holdSince = clockTicks;
+            heldLines++;
+          }
+          _held = true;
+          _n++;
+          continue;
+        }
+        if(holding) {
+          holding = false;
+          heldTicks += clockTicks - holdSince;
+        }
+        credits--;
+      }
+      if(rxFree < clockTicks) {
+        rxFree = clockTicks;
+      }
+      for(size_t _i = 0; _i < _line.size(); _i++) {
+        rxFree += SIM_BYTE_TICKS;
+        rx.push_back(std::make_pair(rxFree, _line[_i]));
+      }
+      script.erase(script.begin() + _n);
+    }
+  }
+
+  /**
+   * Loads the serial script.
+   */
+  void loadScript(std::istream &_in) {
+    std::string _line;
+    uint64_t _at = 0;
+    while(std::getline(_in, _line)) {
+      if(!_line.empty() && _line[0] == '@') {
+        size_t _end = _line.find(' ');
+        _at = strtoull(_line.c_str() + 1, NULL, 10) * 1000 * SIM_TICKS_PER_US;
+        _line = (_end == std::string::npos) ? "" : _line.substr(_end + 1);
+        if(_line.empty()) {
+          continue;
+        }
+      }
+      rx_t _rx = {_at, _line + "\n"};
+      script.push_back(_rx);
+    }
+  }
+
+  void printCost(const char *_name, const cost_t &_cost) {
+    if(!_cost.calls) {
+      return;
+    }
+    fprintf(stderr, "%-6s %10u calls %8.1f ns avg %8llu ns max\n", _name,
+            _cost.calls, double(_cost.totalNs) / _cost.calls,
+            (unsigned long long)_cost.maxNs);
+  }
+}
+
+void HostRegister8::write(uint8_t _value) {
+  uint8_t _old = value;
+  if(port == HOST_REG_FLAGS) {
+    value &= ~_value;
+    return;
+  }
+  if(port == HOST_REG_FORCE) {
+    // Force output compare strobes change the pins but raise no interrupt.
+    if(_value & _BV(FOC1A)) HostSim::compareOutput(0);
+    if(_value & _BV(FOC1B)) HostSim::compareOutput(1);
+    return;
+  }
+  if(port == HOST_REG_TWCR) {
+    // Writing a one clears TWINT and starts the next bus action.
+    value = (_value & ~_BV(TWINT)) |
+            ((_value & _BV(TWINT)) ? 0 : (_old & _BV(TWINT)));
+    if((_value & _BV(TWINT)) && (_value & _BV(TWEN))) {
+      HostSim::twiControl(_value);
+    }
+    else if(!(_value & _BV(TWEN))) {
+      // Disabling the peripheral drops the running bus action.
+      HostSim::twiPhase = SIM_TWI_FREE;
+      HostSim::twiDue = 0;
+    }
+    return;
+  }
+  value = _value;
+  if(port == HOST_REG_PORTB) {
+    HostSim::portWrite(_old, _value);
+  }
+}
+
+void sei() {
+  HostSim::interrupts = true;
+  HostSim::dispatch();
+}
+
+void cli() {
+  HostSim::interrupts = false;
+}
+
+void pinMode(uint8_t _pin, uint8_t _mode) {
+}
+
+void digitalWrite(uint8_t _pin, uint8_t _value) {
+  if(_pin < 8 || _pin > 13) {
+    return;
+  }
+  if(_value) {
+    PORTB |= _BV(_pin - 8);
+  }
+  else {
+    PORTB &= ~_BV(_pin - 8);
+  }
+}
+
+unsigned long millis() {
+  return HostSim::clockTicks / (1000 * SIM_TICKS_PER_US);
+}
+
+unsigned long micros() {
+  return HostSim::clockTicks / SIM_TICKS_PER_US;
+}
+
+void delay(unsigned long _ms) {
+  HostSim::advance(uint64_t(_ms) * 1000 * SIM_TICKS_PER_US);
+}
+
+void HardwareSerial::begin(unsigned long _baud) {
+}
+
+int HardwareSerial::available() {
+  int _n = 0;
+  for(size_t _i = 0; _i < HostSim::rx.size(); _i++) {
+    if(HostSim::rx[_i].first > HostSim::clockTicks) {
+      break;
+    }
+    _n++;
+  }
+  return _n;
+}
+
+int HardwareSerial::read() {
+  if(!available()) {
+    return -1;
+  }
+  char _c = HostSim::rx.front().second;
+  HostSim::rx.pop_front();
+  return (unsigned char)_c;
+}
+
+int HardwareSerial::peek() {
+  if(!available()) {
+    return -1;
+  }
+  return (unsigned char)HostSim::rx.front().second;
+}
+
+size_t HardwareSerial::write(uint8_t _b) {
+  if(_b == '\n') {
+    std::string &_line = HostSim::txLine;
+    if(_line.compare(0, 2, "G ") == 0 && _line[2] != '-') {
+      HostSim::credits += strtoul(_line.c_str() + 2, NULL, 10);
+    }
+    _line.clear();
+  }
+  else if(_b != '\r') {
+    HostSim::txLine += char(_b);
+  }
+  return fputc(_b, stdout) == EOF ? 0 : 1;
+}
+
+size_t HardwareSerial::print(const char *_str) {
+  size_t _n = 0;
+  while(*_str) {
+    _n += write(*_str++);
+  }
+  return _n;
+}
+
+size_t HardwareSerial::print(char _c) {
+  return write(_c);
+}
+
+size_t HardwareSerial::print(long _n, int _base) {
+  if(_n < 0) {
+    return write('-') + print((unsigned long)-_n, _base);
+  }
+  return print((unsigned long)_n, _base);
+}
+
+size_t HardwareSerial::print(unsigned long _n, int _base) {
+  char _digits[24];
+  snprintf(_digits, sizeof(_digits), _base == HEX ? "%lX" : "%lu", _n);
+  return print(_digits);
+}
+
+size_t HardwareSerial::println() {
+  return print("\r\n");
+}
+
+bool eeprom_is_ready() {
+  return HostSim::clockTicks >= HostSim::eepromReady;
+}
+
+uint8_t eeprom_read_byte(const uint8_t *_addr) {
+  if(!eeprom_is_ready()) {                  // As eeprom_busy_wait.
+    HostSim::advance(HostSim::eepromReady - HostSim::clockTicks);
+  }
+  return HostSim::eeprom[uintptr_t(_addr) % SIM_EEPROM_SIZE];
+}
+
+uint16_t eeprom_read_word(const uint16_t *_addr) {
+  const uint8_t *_byte = (const uint8_t *)_addr;
+  return eeprom_read_byte(_byte) | (eeprom_read_byte(_byte + 1) << 8);
+}
+
+void eeprom_read_block(void *_dst, const void *_src, size_t _n) {
+  for(size_t _i = 0; _i < _n; _i++) {
+    ((uint8_t *)_dst)[_i] = eeprom_read_byte((const uint8_t *)_src + _i);
+  }
+}
+
+void eeprom_update_byte(uint8_t *_addr, uint8_t _value) {
+  if(eeprom_read_byte(_addr) == _value) {
+    return;
+  }
+  HostSim::eeprom[uintptr_t(_addr) % SIM_EEPROM_SIZE] = _value;
+  HostSim::eepromWrites++;
+  HostSim::eepromReady = HostSim::clockTicks + SIM_EEPROM_TICKS;
+}
+
+void eeprom_update_word(uint16_t *_addr, uint16_t _value) {
+  eeprom_update_byte((uint8_t *)_addr, _value);
+  eeprom_update_byte((uint8_t *)_addr + 1, _value >> 8);
+}
+
+void eeprom_update_block(const void *_src, void *_dst, size_t _n) {
+  for(size_t _i = 0; _i < _n; _i++) {
+    eeprom_update_byte((uint8_t *)_dst + _i, ((const uint8_t *)_src)[_i]);
+  }
+}
+
+int main(int argc, char **argv) {
+  uint64_t _runMs = 10000;
+  const char *_script = NULL;
+  const char *_image = NULL;
+  for(int _i = 1; _i < argc; _i++) {
+    std::string _arg = argv[_i];
+    if(_arg == "-t" && _i + 1 < argc) {
+      _runMs = strtoull(argv[++_i], NULL, 10);
+    }
+    else if(_arg == "-l" && _i + 1 < argc) {
+      HostSim::loopTicks = strtoull(argv[++_i], NULL, 10);
+    }
+    else if(_arg == "-w") {
+      HostSim::traceWidth = true;
+    }
+    else if(_arg == "-m" && _i + 1 < argc) {
+      sscanf(argv[++_i], "%lf,%lf,%lf,%lf", &HostSim::rockPitch,
+             &HostSim::rockRoll, &HostSim::rockPeriod, &HostSim::gyroBias);
+    }
+    else if(_arg == "-s" && _i + 1 < argc) {
+      unsigned long long _from = 0, _to = 0;
+      sscanf(argv[++_i], "%llu,%llu", &_from, &_to);
+      HostSim::stallFrom = _from * 1000 * SIM_TICKS_PER_US;
+      HostSim::stallTo = _to * 1000 * SIM_TICKS_PER_US;
+    }
+    else if(_arg == "-k") {
+      HostSim::streamCredits = true;
+    }
+    else if(_arg == "-e" && _i + 1 < argc) {
+      _image = argv[++_i];
+    }
+    else {
+      _script = argv[_i];
+    }
+  }
+  if(_script) {
+    std::ifstream _in(_script);
+    if(!_in) {
+      fprintf(stderr, "HostSim: cannot open %s\n", _script);
+      return 1;
+    }
+    HostSim::loadScript(_in);
+  }
+  else {
+    HostSim::loadScript(std::cin);
+  }
+
+  memset(HostSim::eeprom, 0xFF, SIM_EEPROM_SIZE);
+  if(_image) {
+    std::ifstream _in(_image, std::ios::binary);
+    _in.read((char *)HostSim::eeprom, SIM_EEPROM_SIZE);
+  }
+
+  HostSim::mpuReg[SIM_MPU_PWR_MGMT_1] = SIM_MPU_SLEEP;
+  HostSim::mpuReg[SIM_MPU_WHO_AM_I] = SIM_MPU_ADDRESS;
+
+  HostSim::host_clock::time_point _start = HostSim::host_clock::now();
+  uint64_t _end = _runMs * 1000 * SIM_TICKS_PER_US;
+  setup();
+  while(HostSim::clockTicks < _end) {
+    HostSim::feedSerial();
+    HostSim::measure(HostSim::loopCost, loop);
+    HostSim::advance(HostSim::loopTicks);
+  }
+  double _wallMs = std::chrono::duration<double, std::milli>(
+                     HostSim::host_clock::now() - _start).count();
+  fflush(stdout);
+  if(_image) {
+    std::ofstream _out(_image, std::ios::binary);
+    _out.write((const char *)HostSim::eeprom, SIM_EEPROM_SIZE);
+  }
+
+  fprintf(stderr, "simulated %llu ms in %.1f ms (%.0fx real time)\n",
+          (unsigned long long)_runMs, _wallMs, _runMs / _wallMs);
+  fprintf(stderr, "frames A %u B %u\n", HostSim::frames[0],
+          HostSim::frames[1]);
+  HostSim::printCost("loop", HostSim::loopCost);
+  HostSim::printCost("isr A", HostSim::isrCost[0]);
+  HostSim::printCost("isr B", HostSim::isrCost[1]);
+  HostSim::printCost("isr T", HostSim::twiCost);
+  if(HostSim::twiBursts) {
+    fprintf(stderr, "mpu bursts %u\n", HostSim::twiBursts);
+  }
+  if(HostSim::streamCredits) {
+    fprintf(stderr, "credits held %u lines for %llu ms\n", HostSim::heldLines,
+            (unsigned long long)(HostSim::heldTicks / SIM_TICKS_PER_US / 1000));
+  }
+  if(HostSim::eepromWrites) {
+    fprintf(stderr, "eeprom writes %u\n", HostSim::eepromWrites);
+  }
+  fprintf(stderr, "width");
+  for(uint8_t _ch = 0; _ch < SIM_CHANNELS; _ch++) {
+    fprintf(stderr, " %u", HostSim::width[_ch]);
+  }
+  fprintf(stderr, "\n");
+  return 0;
+}
@@ -0,0 +1,192 @@
+/**
+ * Tool of RoboPrime Firmware.
+ *
+ * Arduino.h
+ * Host replacement for the Arduino core and the ATmega328P registers used by
+ * the firmware.
+ *
+ * RoboPrime Firmware, (https://github.com/simonepri/RoboPrime)
+ * Copyright (c) 2015, Simone Primarosa, (https://simoneprimarosa.com)
+ *
+ * Licensed under The MIT License
+ * Redistribution of file must retain the above copyright notice.
+ *
+ * @copyright     Copyright (c) 2015, Simone Primarosa, (https://simoneprimarosa.com)
+ * @link          (https://github.com/simonepri/RoboPrime)
+ * @since         0.0.0
+ * @license       MIT License (https://opensource.org/licenses/MIT)
+ */
+
+/*
+ * PURPOSE:
+ *
+ * This header is found before the real Arduino.h when the firmware sources
+ * are compiled by the HostSim makefile. It only provides what the firmware
+ * actually uses:
+ *  - PROGMEM and the pgm_read_* readers (flash is plain memory on the host).
+ *  - Timer1 registers (TCNT1, OCR1A, OCR1B, TCCR1A, TCCR1B, TIMSK1, TIFR1).
+ *  - PORTB, whose writes are traced so the 4017 outputs can be rebuilt.
+ *  - TWI registers (TWBR, TWSR, TWDR, TWCR), whose TWCR writes drive a
+ *    simulated I2C bus with an MPU-6050 on it, and util/twi.h.
+ *  - sei()/cli(), ISR(), the Timer1 compare vectors and the TWI vector.
+ *  - pinMode, digitalWrite, millis, micros and a Serial object.
+ *
+ * Time is virtual: TCNT1 only moves when HostSim advances the clock, and the
+ * compare-match vectors are called when the counter crosses OCR1A/OCR1B.
+ */
+
+#ifndef _HOST_ARDUINO_H
+#define _HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH                        1
+#define LOW                         0
+#define INPUT                       0
+#define OUTPUT                      1
+
+#define DEC                        10
+#define HEX                        16
+
+#define F_CPU               16000000UL
+#define clockCyclesPerMicrosecond() (F_CPU / 1000000UL)
+
+#define _BV(bit) (1 << (bit))
+
+// Flash is ordinary memory on the host.
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (s)
+
+inline uint8_t pgm_read_byte_near(const void *_addr) {
+  return *(const uint8_t *)_addr;
+}
+
+inline uint16_t pgm_read_word_near(const void *_addr) {
+  uint16_t _word;
+  memcpy(&_word, _addr, sizeof(_word));
+  return _word;
+}
+
+inline uint32_t pgm_read_dword_near(const void *_addr) {
+  uint32_t _dword;
+  memcpy(&_dword, _addr, sizeof(_dword));
+  return _dword;
+}
+
+#define pgm_read_byte(addr) pgm_read_byte_near(addr)
+#define pgm_read_word(addr) pgm_read_word_near(addr)
+#define pgm_read_dword(addr) pgm_read_dword_near(addr)
+#define memcpy_P memcpy
+
+// Timer1 and PORTB bit positions, as in <avr/iom328p.h>.
+#define TOV1                        0
+#define OCF1A                       1
+#define OCF1B                       2
+#define TOIE1                       0
+#define OCIE1A                      1
+#define OCIE1B                      2
+#define WGM10                       0
+#define WGM11                       1
+#define COM1B0                      4
+#define COM1B1                      5
+#define COM1A0                      6
+#define COM1A1                      7
+#define CS10                        0
+#define CS11                        1
+#define CS12                        2
+#define FOC1B                       6
+#define FOC1A                       7
+
+// TWI bit positions, as in <avr/iom328p.h>.
+#define TWIE                        0
+#define TWEN                        2
+#define TWWC                        3
+#define TWSTO                       4
+#define TWSTA                       5
+#define TWEA                        6
+#define TWINT                       7
+
+#define HOST_REG_PORTB              0     // Writes are traced.
+#define HOST_REG_FLAGS              1     // Writing a one clears the bit.
+#define HOST_REG_FORCE              2     // Writing a one forces a match.
+#define HOST_REG_TWCR               3     // Writes drive the I2C bus.
+
+/**
+ * 8 bit register whose writes are reported to the simulator.
+ */
+class HostRegister8 {
+  public:
+    HostRegister8(uint8_t _port) : port(_port), value(0) {}
+    void set(uint8_t _value) { value = _value; }
+    operator uint8_t() const { return value; }
+    HostRegister8 &operator=(uint8_t _value) { write(_value); return *this; }
+    HostRegister8 &operator|=(uint8_t _value) { write(value | _value); return *this; }
+    HostRegister8 &operator&=(uint8_t _value) { write(value & _value); return *this; }
+    HostRegister8 &operator^=(uint8_t _value) { write(value ^ _value); return *this; }
+  private:
+    void write(uint8_t _value);
+    uint8_t port, value;
+};
+
+extern volatile uint16_t TCNT1, OCR1A, OCR1B;
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1, SREG;
+extern HostRegister8 PORTB, TIFR1, TCCR1C;
+extern volatile uint8_t TWBR, TWSR, TWDR, TWAR;
+extern HostRegister8 TWCR;
+
+void sei();
+void cli();
+
+#define ISR(vector) extern "C" void vector(void)
+
+#define TIMER1_COMPA_vect __vector_11
+#define TIMER1_COMPB_vect __vector_12
+#define TIMER1_OVF_vect   __vector_13
+#define TWI_vect          __vector_24
+
+// Vectors are weak so that the firmware only has to define the ones it uses.
+extern "C" void TIMER1_COMPA_vect(void) __attribute__((weak));
+extern "C" void TIMER1_COMPB_vect(void) __attribute__((weak));
+extern "C" void TIMER1_OVF_vect(void) __attribute__((weak));
+extern "C" void TWI_vect(void) __attribute__((weak));
+
+void pinMode(uint8_t _pin, uint8_t _mode);
+void digitalWrite(uint8_t _pin, uint8_t _value);
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long _ms);
+
+/**
+ * Serial port backed by the simulator input script and stdout.
+ */
+class HardwareSerial {
+  public:
+    void begin(unsigned long _baud);
+    int available();
+    int read();
+    int peek();
+    size_t write(uint8_t _b);
+    size_t print(const char *_str);
+    size_t print(char _c);
+    size_t print(long _n, int _base = DEC);
+    size_t print(unsigned long _n, int _base = DEC);
+    size_t print(int _n, int _base = DEC) { return print(long(_n), _base); }
+    size_t print(unsigned int _n, int _base = DEC) { return print((unsigned long)_n, _base); }
+    size_t print(uint8_t _n, int _base = DEC) { return print((unsigned long)_n, _base); }
+    size_t println();
+    template<typename T> size_t println(T _v) { size_t _n = print(_v); return _n + println(); }
+    template<typename T> size_t println(T _v, int _base) { size_t _n = print(_v, _base); return _n + println(); }
+};
+
+extern HardwareSerial Serial;
+
+void setup();
+void loop();
+
+#endif
@@ -0,0 +1,37 @@
+/**
+ * Tool of RoboPrime Firmware.
+ *
+ * eeprom.h
+ * Host replacement for the EEPROM access of <avr/eeprom.h>.
+ *
+ * RoboPrime Firmware, (https://github.com/simonepri/RoboPrime)
+ * Copyright (c) 2015, Simone Primarosa, (https://simoneprimarosa.com)
+ *
+ * Licensed under The MIT License
+ * Redistribution of file must retain the above copyright notice.
+ *
+ * @copyright     Copyright (c) 2015, Simone Primarosa, (https://simoneprimarosa.com)
+ * @link          (https://github.com/simonepri/RoboPrime)
+ * @since         0.0.0
+ * @license       MIT License (https://opensource.org/licenses/MIT)
+ */
+
+#ifndef _HOST_AVR_EEPROM_H
+#define _HOST_AVR_EEPROM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define E2END                   0x3FF     // 1KB, as on the ATmega328P.
+
+// Implemented by HostSim. Every byte that changes takes the write time, the
+// firmware runs meanwhile and the next access waits for the write to end.
+bool eeprom_is_ready();
+uint8_t eeprom_read_byte(const uint8_t *_addr);
+uint16_t eeprom_read_word(const uint16_t *_addr);
+void eeprom_read_block(void *_dst, const void *_src, size_t _n);
+void eeprom_update_byte(uint8_t *_addr, uint8_t _value);
+void eeprom_update_word(uint16_t *_addr, uint16_t _value);
+void eeprom_update_block(const void *_src, void *_dst, size_t _n);
+
+#endif